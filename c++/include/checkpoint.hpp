@@ -0,0 +1,108 @@
+#pragma once
+#include <gray_scott.hpp>
+#include <matrix.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <string>
+
+namespace GrayScott {
+
+// Checkpoint file: one page of header, then the U and V planes, each starting
+// on a page boundary. A plane is the byte image of the field's whole Matrix
+// allocation (ghost cells and row padding included) in the storage type, so
+// a mapping of the file can serve as the field without being parsed or copied.
+struct CheckpointHeader {
+    static constexpr char magic_value[8] = {'G', 'S', 'C', 'K', 'P', 'T', '\r', '\n'};
+    static constexpr uint32_t current_version = 1;
+    static constexpr size_t page = 4096;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t header_bytes;
+
+    // Params, optionals are -1 when unset
+    Float32 Du, Dv, F, k, dt, initial_noise;
+    uint32_t Nx, Ny, Ns, fps;
+    int64_t seed, Nsteps, threads, time_block;
+    uint32_t storage;
+
+    uint64_t step;
+
+    // layout of each plane, counts in elements
+    uint32_t element_bytes;
+    uint32_t halo;
+    uint32_t row_align;  // bytes
+    uint64_t pitch;
+    uint64_t origin;     // offset of cell (0, 0) from the start of the plane
+    uint64_t plane_offset[2];
+    uint64_t plane_bytes;
+
+    // Params::activity_threshold, 0 when unset, and activity_skip; zero in
+    // files written before these were saved
+    Float32 activity_threshold;
+    uint32_t activity_skip;
+    uint32_t pattern; // Params::pattern, zero (noise) in older files
+    uint32_t pages;   // Params::pages, zero (normal) in older files
+
+    static CheckpointHeader make(const Params& params, uint64_t step, size_t element_bytes,
+                                 const matrix::Layout& layout, size_t pitch, size_t origin, size_t storage_bytes);
+    Params params() const;
+    matrix::Layout layout() const { return {halo, row_align}; }
+    bool valid() const;
+};
+static_assert(sizeof(CheckpointHeader) <= CheckpointHeader::page);
+
+// A checkpoint mapped privately (copy on write) into memory. fields() hands
+// out matrices backed directly by the mapping; the mapping lives as long as
+// the checkpoint or any of those matrices.
+class MappedCheckpoint : public std::enable_shared_from_this<MappedCheckpoint> {
+public:
+    // nullptr if the file cannot be mapped or is not a valid checkpoint
+    static std::shared_ptr<MappedCheckpoint> map(const std::string& path);
+    ~MappedCheckpoint();
+
+    const CheckpointHeader& header() const { return *static_cast<const CheckpointHeader*>(base); }
+
+    template <typename T>
+    std::pair<matrix::Matrix<T, 2>, matrix::Matrix<T, 2>> fields()
+    {
+        const auto& h = header();
+        const typename matrix::Matrix<T, 2>::Shape shape{h.Nx, h.Ny};
+        auto plane = [&](int i) {
+            T* storage = reinterpret_cast<T*>(static_cast<std::byte*>(base) + h.plane_offset[i]);
+            return matrix::Matrix<T, 2>::from_storage(storage, shape, h.layout(), shared_from_this());
+        };
+        return {plane(0), plane(1)};
+    }
+
+private:
+    MappedCheckpoint() = default;
+    void* base = nullptr;
+    size_t length = 0;
+    bool mapped = false; // false: base is a heap copy (no mmap on this platform)
+};
+
+// Writes a complete file image on a background thread, to path.tmp and then
+// renamed to path, so a partial checkpoint never appears under path.
+std::future<bool> write_checkpoint(const std::string& path, std::shared_ptr<std::byte[]> image, size_t bytes);
+
+// Snapshot of the two fields, copied now and written by write_checkpoint.
+template <typename T>
+std::future<bool> checkpoint_fields(const std::string& path, const Params& params, uint64_t step,
+                                  const matrix::Matrix<T, 2>& U, const matrix::Matrix<T, 2>& V)
+{
+    const size_t storage_bytes = U.total_bytes() + U.get_layout().row_align;
+    const auto h = CheckpointHeader::make(params, step, sizeof(T), U.get_layout(), U.get_strides()[0],
+                                          U.get_origin(), storage_bytes);
+    const size_t bytes = h.plane_offset[1] + h.plane_bytes;
+    std::shared_ptr<std::byte[]> image(new std::byte[bytes]());
+    std::memcpy(image.get(), &h, sizeof(h));
+    std::memcpy(image.get() + h.plane_offset[0], U.get_storage(), U.total_bytes());
+    std::memcpy(image.get() + h.plane_offset[1], V.get_storage(), V.total_bytes());
+    return write_checkpoint(path, std::move(image), bytes);
+}
+
+} // namespace GrayScott
@@ -0,0 +1,91 @@
+#pragma once
+#include <matrix.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace GrayScott {
+
+// One part of a decomposed grid: rows [row0, row0 + Nx) and columns
+// [col0, col0 + Ny) of the whole torus, at row, col of the subdomain grid.
+struct Subdomain {
+    unsigned row, col;
+    unsigned row0, col0;
+    unsigned Nx, Ny;
+};
+
+// An Nx x Ny torus split into rows x cols subdomains, each stepped by its own
+// process through Backend::create(type, domain, index), with the halos
+// exchanged through a POSIX shared memory segment. After every step a
+// subdomain publishes its edges (first and last row and column, and the four
+// corners) into records of the segment; before the next step it copies its
+// eight neighbours' edges into its ghost ring.
+//
+// Each edge has two buffers, used on even and odd steps, each with a
+// sequence counter that is odd while the buffer is written and 2 * step + 2
+// once the edges after step are complete. A neighbour can be at most one
+// step ahead, as it needs this subdomain's edges to get there, so a buffer
+// is never rewritten while it is still to be read. There are no locks:
+// readers spin, then yield, until the counter they need appears, and check
+// it again after the copy.
+class SharedDomain {
+public:
+    // Creates the segment name (shm_open) for a new decomposition; nullptr
+    // if it already exists, a subdomain would be empty or shared memory is
+    // not available.
+    static std::shared_ptr<SharedDomain> create(const std::string& name, unsigned Nx, unsigned Ny,
+                                                unsigned rows, unsigned cols);
+    // Maps the segment of a decomposition created by another process;
+    // nullptr if there is none by that name.
+    static std::shared_ptr<SharedDomain> open(const std::string& name);
+    // Removes the name; processes that mapped it keep their mapping.
+    static bool unlink(const std::string& name);
+    ~SharedDomain();
+
+    SharedDomain(const SharedDomain&) = delete;
+    SharedDomain& operator=(const SharedDomain&) = delete;
+
+    unsigned Nx() const;
+    unsigned Ny() const;
+    unsigned rows() const;
+    unsigned cols() const;
+    unsigned size() const { return rows() * cols(); }
+    // Subdomain index, row-major over the subdomain grid; the rows and
+    // columns of the torus are split as evenly as parallel::ThreadPool::band
+    // splits them.
+    Subdomain subdomain(unsigned index) const;
+
+    // The next subdomain no process has claimed, so that identical
+    // processes can each take one; nullopt once all are taken.
+    std::optional<unsigned> claim();
+
+    // Publishes the edges of subdomain index after step steps. U and V are
+    // its fields, Subdomain::Nx x Ny with a ghost ring.
+    void publish(unsigned index, uint64_t step, const matrix::Matrix<float, 2>& U,
+                 const matrix::Matrix<float, 2>& V);
+    // Fills the ghost rings of U and V with the neighbours' edges after step
+    // steps, waiting for them to be published.
+    void receive(unsigned index, uint64_t step, matrix::Matrix<float, 2>& U, matrix::Matrix<float, 2>& V);
+
+private:
+    struct Header;
+    struct Buffer;
+
+    SharedDomain() = default;
+    Buffer& buffer(unsigned index, unsigned edge, uint64_t step) const;
+
+    Header* header = nullptr;
+    size_t length = 0;
+};
+
+// NUMA nodes of this host, 1 where that cannot be read (Linux sysfs).
+unsigned numa_node_count();
+
+// Restricts the calling thread to the CPUs of NUMA node node (Linux). Called
+// before the backend is created, its workers inherit the mask and the whole
+// process of a subdomain stays on one socket. False if it cannot be set.
+bool pin_to_numa_node(unsigned node);
+
+} // namespace GrayScott
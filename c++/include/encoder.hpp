@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace GrayScott {
+
+// Headless frame stream for piping into an external encoder.
+//   Y4M: YUV4MPEG2, 4:2:0 full range (C420jpeg), one "FRAME" per frame
+//   PPM: concatenated binary P6 images, as ffmpeg's image2pipe reads them
+enum class StreamFormat { Y4M, PPM };
+
+// How the encoded bytes reach the file:
+//   buffered: one write() per frame from a preallocated frame buffer
+//   direct:   O_DIRECT, 4 KiB aligned writes bypassing the page cache
+//   mmap:     frames are encoded straight into a mapping of the file
+// direct and mmap need a regular file on Linux; elsewhere, for stdout, or if
+// the filesystem refuses O_DIRECT the stream falls back to buffered.
+enum class WriteMode { buffered, direct, mmap };
+
+class FrameEncoder {
+public:
+    // path "-" writes to stdout. Returns nullptr if the file cannot be opened.
+    static std::unique_ptr<FrameEncoder> open(const std::string& path, StreamFormat format,
+                                              unsigned width, unsigned height, unsigned fps,
+                                              WriteMode mode = WriteMode::buffered);
+    ~FrameEncoder();
+
+    FrameEncoder(const FrameEncoder&) = delete;
+    FrameEncoder& operator=(const FrameEncoder&) = delete;
+
+    // Encodes one RGBA8 frame of width x height pixels, rows pitch bytes
+    // apart. Returns false once a write has failed.
+    bool write_frame(const uint8_t* rgba, size_t pitch);
+    // Flushes and truncates the file to its real size; called by the destructor.
+    bool close();
+
+    WriteMode mode() const { return write_mode; }
+    size_t frame_bytes() const { return frame_size; }
+    uint64_t bytes_written() const { return offset; }
+
+private:
+    FrameEncoder(StreamFormat format, unsigned width, unsigned height);
+
+    void encode(uint8_t* dst, const uint8_t* rgba, size_t pitch) const;
+    bool write_all(const uint8_t* data, size_t n);
+    bool write_direct(const uint8_t* rgba, size_t pitch);
+    bool write_mapped(const uint8_t* rgba, size_t pitch);
+
+    StreamFormat format;
+    unsigned width, height;
+    WriteMode write_mode = WriteMode::buffered;
+    int fd = -1;
+    std::FILE* file = nullptr;  // buffered writes when fd is not used
+    bool owns_file = false;
+    bool ok = true;
+    bool closed = false;
+
+    std::string frame_header;
+    size_t frame_size = 0;      // header and payload of one frame
+    uint64_t offset = 0;        // bytes of the stream produced so far
+    uint64_t reserved = 0;      // mmap: current file size
+
+    // buffered: one frame; direct: a frame plus the unaligned tail of the last
+    std::unique_ptr<uint8_t[], void (*)(uint8_t*)> buffer{nullptr, nullptr};
+    size_t pending = 0;         // direct: bytes in buffer not yet written
+};
+
+} // namespace GrayScott
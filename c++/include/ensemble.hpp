@@ -0,0 +1,47 @@
+#pragma once
+#include <gray_scott.hpp>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GrayScott {
+
+// Feed and kill rate of one ensemble member.
+struct EnsembleMember {
+    Float32 F;
+    Float32 k;
+};
+
+// A batch of independent simulations on one Nx x Ny grid that differ only in
+// F and k, e.g. the thumbnails of a parameter atlas. The cells of all members
+// are stored interleaved (kernels::EnsembleArgs), so the SIMD lanes of the
+// step run across members and each stencil load serves a whole vector of
+// them. Every member starts from the state Backend::initialize would create
+// from the same Params.
+struct Ensemble
+{
+    virtual ~Ensemble() = default;
+    // Du, Dv, dt, the grid, initial noise, seed and threads come from params;
+    // its F and k are replaced by those of each member.
+    virtual bool initialize(const Params& params, const std::vector<EnsembleMember>& members) = 0;
+    virtual void gray_scott_step(float dt) = 0;
+    virtual void gray_scott_steps(float dt, unsigned n_steps) = 0;
+    virtual size_t size() const = 0;
+    virtual void set_colormap(const Colormap& colormap) = 0;
+    // Renders one member into Nx rows of Ny pixels, as Backend::copy_to_output.
+    // A member past size() writes nothing, here and in read_state.
+    virtual void copy_to_output(size_t member, void* output, OutputFormat format, size_t pitch) = 0;
+    // Renders all members as an atlas of Nx x Ny thumbnails, columns per row,
+    // member m at row m / columns and column m % columns. Pitch 0 means rows
+    // of columns * Ny pixels; tiles past the last member are left untouched.
+    virtual void copy_atlas_to_output(unsigned columns, void* output, OutputFormat format, size_t pitch) = 0;
+    // Nx*Ny row-major copies of the current U and V of one member
+    virtual void read_state(size_t member, float* U, float* V) const = 0;
+    // Kernel names as in Backend::create: "auto", "scalar", "sse42", "avx2",
+    // "avx512", each with a "threaded-" variant ("threaded" is threaded-auto).
+    // nullptr if unknown or not supported by this CPU.
+    static std::unique_ptr<Ensemble> create(const std::string& type);
+};
+
+} // namespace GrayScott
@@ -1,4 +1,9 @@
 #pragma once
+#include <matrix.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <future>
 #include <utility>
 #include <optional>
 #include <memory>
@@ -8,6 +13,18 @@ namespace GrayScott {
 
 using Float32 = float;
 
+// Element type U and V are stored in. The step always computes in fp32;
+// f16 (IEEE half) and bf16 halve the bytes moved per cell.
+enum class Storage { f32, f16, bf16 };
+
+// Initial state presets; every cell also gets initial_noise of uniform noise.
+// noise: U = 1, V = 0 everywhere. square: in addition an Ns x Ns square of
+// U = 0.5, V = 0.25 at the centre. spots: such squares at random places,
+// about one per 32 squares' worth of cells.
+enum class Pattern { noise, square, spots };
+
+class SharedDomain;
+
 struct Params {
     Float32 Du; // Diffusion rate of U
     Float32 Dv; // Diffusion rate of V
@@ -20,14 +37,97 @@ struct Params {
     std::optional<unsigned> seed;
     std::optional<unsigned> Nsteps;
     unsigned fps;
+    std::optional<unsigned> threads = {}; // worker count, hardware concurrency if unset
+    std::optional<unsigned> time_block = {}; // steps advanced per cache-resident tile in gray_scott_steps
+    Storage storage = Storage::f32;
+    // Activity mask: a tile whose largest |dU|, |dV| in a step, and that of
+    // its eight neighbours, is below the threshold skips the next
+    // activity_skip steps, unless a neighbour becomes active again first.
+    // Kernel backends with fp32 storage; unset steps every cell.
+    std::optional<Float32> activity_threshold = {};
+    unsigned activity_skip = 8;
+    // Pages of the fields (matrix::Allocator); threaded backends also first
+    // touch each worker's band of rows from that worker.
+    matrix::Pages pages = matrix::Pages::normal;
+    // Initial state; the same for a given seed and pattern whatever the
+    // backend or thread count.
+    Pattern pattern = Pattern::noise;
 };
+
+// Tiles stepped and skipped by the activity mask since initialize.
+struct ActivityStats {
+    uint64_t tiles_stepped = 0;
+    uint64_t tiles_skipped = 0;
+};
+
+// Pixel layouts copy_to_output can write, 4, 4 and 1 bytes per pixel.
+enum class OutputFormat : int { RGBA8, BGRA8, Gray8 };
+
+// Maps the selected field linearly from [lo, hi] onto the 256 entries of lut
+// (RGBA8, R in the lowest byte); values outside the range clamp to the ends.
+// Gray8 output writes the entry index itself.
+struct Colormap {
+    enum class Source { V, U_minus_V };
+    Source source = Source::V;
+    Float32 lo = 0.0f;
+    Float32 hi = 0.5f;
+    std::array<uint32_t, 256> lut = default_lut();
+
+    static std::array<uint32_t, 256> default_lut();
+    // lut with R and B exchanged, for BGRA8 output
+    std::array<uint32_t, 256> bgra_lut() const;
+    // Entries per unit of the field, 255 / (hi - lo); 0 when hi <= lo, so an
+    // empty or inverted range maps every cell to the first entry.
+    Float32 scale() const;
+};
+
+// Zero-copy view of the current state: the first cell of row 0 of U and V,
+// in Storage elements, with rows pitch elements apart. Valid until the next
+// step or initialize.
+struct FieldView {
+    const void* U;
+    const void* V;
+    Storage storage;
+    size_t pitch;
+    unsigned rows, cols;
+};
+
 struct Backend
 {
+    virtual ~Backend() = default;
     virtual bool initialize(const Params&) = 0;
     virtual void gray_scott_step(float dt) = 0;
-    // assuming width and height the same as in Params
-    virtual void copy_to_output(void* output, int format) = 0; 
+    virtual void gray_scott_steps(float dt, unsigned n_steps) = 0;
+    // Renders the current state into a caller-provided framebuffer of Nx rows
+    // of Ny pixels, pitch bytes apart (0 for tightly packed rows).
+    virtual void copy_to_output(void* output, OutputFormat format, size_t pitch) = 0;
+    // gray_scott_step followed by copy_to_output, in a single pass where the
+    // backend supports it.
+    virtual void gray_scott_step_to_output(float dt, void* output, OutputFormat format, size_t pitch) = 0;
+    virtual void set_colormap(const Colormap& colormap) = 0;
+    virtual FieldView front() const = 0;
+    // Checkpoints (checkpoint.hpp). save_checkpoint copies the current state
+    // now and writes the file in the background. restore_checkpoint
+    // initializes from a checkpoint, its Params included, with the mapped
+    // file as the current state; step receives the saved step count.
+    virtual std::future<bool> save_checkpoint(const std::string& path, uint64_t step) const = 0;
+    virtual bool restore_checkpoint(const std::string& path, uint64_t* step = nullptr) = 0;
+    // Nx*Ny row-major fp32 copies of the current U and V
+    virtual void read_state(float* U, float* V) const = 0;
+    virtual ActivityStats activity_stats() const { return {}; }
     static std::unique_ptr<Backend> create(const std::string& type);
+    // A backend of the given type for subdomain index of a decomposed grid
+    // (domain.hpp). Its Params are those of the whole grid; it steps and
+    // renders only its own Subdomain::Nx x Ny cells, with the halos
+    // exchanged through domain, and it can be initialized only once. nullptr
+    // if type is unknown or index is out of range.
+    static std::unique_ptr<Backend> create(const std::string& type, std::shared_ptr<SharedDomain> domain,
+                                           unsigned index);
 };
 
+// Renders a FieldView, the live state or a copy of it, the way copy_to_output
+// does. Rows of the view must start 32-byte aligned and be readable up to a
+// whole number of 8 cells, as in the backends' own fields.
+void render_frame(const FieldView& field, const Colormap& colormap, void* output, OutputFormat format, size_t pitch);
+
 } // namespace GrayScott
@@ -0,0 +1,163 @@
+#pragma once
+#include <gray_scott.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Row kernels of the fused backends, built once per instruction set in their
+// own translation units (kernels_*.cpp) with that ISA's compiler flags; the
+// rest of the library is built for the baseline ISA and calls them through a
+// Kernels table picked at runtime. Kernel translation units work on raw
+// pointers only, keep their helpers in an anonymous namespace and call no
+// std templates (kernels_common.inl has stand-ins): an instantiation there
+// would be a weak symbol compiled for the wider ISA, which the linker may
+// also hand to baseline callers.
+namespace GrayScott::kernels {
+
+enum class Isa { scalar, sse42, avx2, avx512 };
+
+// 3x3 stencil with the symmetry of the Laplacian: one weight for the centre,
+// one for the four edge neighbours and one for the four corners. The kernels
+// are specialised at compile time for laplacian_stencil (edge and corner sums
+// first, then three multiplies instead of nine); any other StepCoeffs::lap
+// takes the generic nine weight path.
+struct SymmetricStencil {
+    float center, edge, corner;
+
+    constexpr std::array<float, 9> weights() const
+    {
+        return {corner, edge, corner, edge, center, edge, corner, edge, corner};
+    }
+};
+
+inline constexpr SymmetricStencil laplacian_stencil{-1.0f, 0.2f, 0.05f};
+
+// Field rows as laid out by field_layout: cell (0, 0) of row 0, rows stride
+// elements apart, 64-byte aligned and padded to whole cache lines, with a
+// ghost ring that is fresh when a step reads it.
+struct StepCoeffs {
+    float lap[9]; // Laplacian stencil, row major
+    float Du, Dv, F, k, dt;
+};
+
+// Colormap resolved for one output format; lut is already swizzled for BGRA8.
+// A cell maps to lut[clamp((x - lo) * scale, 0, 255)], truncated.
+struct RenderTarget {
+    uint8_t* data;
+    size_t pitch;
+    OutputFormat format;
+    const uint32_t* lut;
+    float lo, scale;
+    bool difference; // x = U - V instead of V
+};
+
+// Temporally blocked pass over rows [row_begin, row_end) of an fp32 field:
+// un/vn get u/v advanced by T steps. ring_u/ring_v hold (T-1) * tile_ring_rows
+// rows of ring_stride elements with the same ghost columns and padding.
+inline constexpr int tile_ring_rows = 4;
+
+struct TileArgs {
+    const float* u;
+    const float* v;
+    float* un;
+    float* vn;
+    std::ptrdiff_t stride;
+    int width, height;
+    unsigned T;
+    int row_begin, row_end;
+    float* ring_u;
+    float* ring_v;
+    std::ptrdiff_t ring_stride;
+};
+
+// Ensemble fields (ensemble.hpp): members in groups of ensemble_lanes, one
+// cache line of fp32. A group is a height x width grid of cells, row major
+// and without ghost cells, each cell holding the lanes of all its members
+// side by side, so the vector lanes of the step run across members. The grid
+// wraps around; unused lanes of the last group just hold copies.
+inline constexpr int ensemble_lanes = 16;
+
+struct EnsembleArgs {
+    const float* u;
+    const float* v;
+    float* un;
+    float* vn;
+    int width, height;
+    const float* F;  // ensemble_lanes feed rates
+    const float* Fk; // ensemble_lanes F + k
+    float Du, Dv, dt;
+};
+
+// Column granularity of step_rows_tracked, the tile width of the activity
+// mask; a whole number of vectors for every kernel.
+inline constexpr int change_cols = 128;
+
+// xoshiro256++ generators stepped in lockstep: s[i][lane] is word i of a
+// lane's state.
+inline constexpr int rng_lanes = 8;
+
+struct RngLanes {
+    alignas(64) uint64_t s[4][rng_lanes];
+};
+
+struct Kernels {
+    Isa isa;
+    const char* name;
+    // Rows [row_begin, row_end) of un/vn from u/v; when out is set the new
+    // rows are rendered to it as well.
+    void (*step_rows)(Storage storage, const void* u, const void* v, void* un, void* vn, std::ptrdiff_t stride,
+                      int width, int row_begin, int row_end, const StepCoeffs& c, const RenderTarget* out);
+    void (*render_rows)(Storage storage, const void* u, const void* v, std::ptrdiff_t stride, int width,
+                        int row_begin, int row_end, const RenderTarget& out);
+    void (*advance_tile)(const TileArgs& args, const StepCoeffs& c);
+    // fp32 <-> 16-bit storage, round to nearest even
+    void (*narrow)(Storage storage, const float* src, uint16_t* dst, size_t n);
+    void (*widen)(Storage storage, const uint16_t* src, float* dst, size_t n);
+    // Rows [row_begin, row_end) of one ensemble group, with laplacian_stencil
+    void (*step_ensemble_rows)(const EnsembleArgs& args, int row_begin, int row_end);
+    // step_rows for fp32 fields that also raises change[i] to the largest
+    // |dU|, |dV| of the step in columns [i, i + 1) * change_cols
+    void (*step_rows_tracked)(const float* u, const float* v, float* un, float* vn, std::ptrdiff_t stride,
+                              int width, int row_begin, int row_end, const StepCoeffs& c, float* change);
+    // n floats uniform in [0, 1), n a whole number of 2 * rng_lanes: each
+    // step of rng gives out[2 * lane] from the low and out[2 * lane + 1] from
+    // the high 32 bits of the lane's draw, 24 bits each. The same for every
+    // ISA.
+    void (*uniform)(RngLanes& rng, float* out, size_t n);
+    // n standard normal floats, n as for uniform: Box-Muller on the two
+    // halves of each lane's draw, cos to out[lane] and sin to
+    // out[rng_lanes + lane] per 2 * rng_lanes. Equal across ISAs to rounding.
+    void (*normal)(RngLanes& rng, float* out, size_t n);
+};
+
+extern const Kernels scalar_kernels;
+extern const Kernels sse42_kernels;
+extern const Kernels avx2_kernels;
+extern const Kernels avx512_kernels;
+
+// CPUID, and for AVX/AVX-512 whether the OS saves the wider registers
+bool cpu_supports(Isa isa);
+// The kernels for isa, nullptr if this CPU cannot run them
+const Kernels* find(Isa isa);
+// By name: "auto" (best), "scalar", "sse42", "avx2" (also "avx256") or
+// "avx512"; nullptr if unknown or not supported by this CPU
+const Kernels* find(std::string_view name);
+// A kernel backend type as Backend::create and Ensemble::create take it: a
+// find() name, or "threaded-" and one for the same kernels on a pool
+// ("threaded" is threaded-auto); kernels is nullptr where find() gives none
+struct BackendType {
+    const Kernels* kernels;
+    bool threaded;
+};
+BackendType parse_backend_type(std::string_view type);
+// The widest kernels this CPU runs, detected once
+const Kernels& best();
+
+// count lane sets of seed: lane l of set i is the seed's xoshiro256++
+// generator advanced by i * rng_lanes + l + 1 jump()s (2^128 draws each), so
+// sets never overlap and the same seed always gives the same sets.
+std::vector<RngLanes> rng_substreams(uint64_t seed, size_t count);
+
+} // namespace GrayScott::kernels
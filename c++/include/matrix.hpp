@@ -6,6 +6,12 @@
 #include <cassert>
 #include <type_traits>
 #include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <utility>
 
 #ifdef _MSC_VER
   #include <malloc.h>
@@ -21,9 +27,108 @@ namespace matrix {
 template <typename T, std::size_t N>
 struct View;
 
+// Memory layout of a Matrix beyond its logical shape. A halo of width h adds
+// h ghost cells on both ends of every axis; get_data() and all indexing still
+// start at element (0, ..., 0), ghost cells sit at negative offsets.
+// A non-zero row_align (bytes, a power of two >= 64) pads the innermost axis
+// so that every row starts on that boundary and the row pitch is a multiple
+// of it; kernels may then use aligned loads and run whole vectors past the
+// end of a row into the padding.
+struct Layout {
+    std::size_t halo = 0;
+    std::size_t row_align = 0;
+
+    bool operator==(const Layout&) const = default;
+};
+
+// Pages behind an allocation.
+enum class Pages : uint8_t {
+    normal,  // aligned_alloc
+    huge,    // 2 MB aligned, transparent huge pages requested with madvise
+    hugetlb, // explicit 2 MB pages (MAP_HUGETLB) from the reserved pool, else huge
+};
+
+// Storage of bytes (a multiple of alignment) for a Matrix. mapped is set to the length
+// to unmap for pages from mmap, 0 for the aligned heap.
+void* allocate_storage(std::size_t bytes, std::size_t alignment, Pages pages, std::size_t& mapped);
+void free_storage(void* storage, std::size_t mapped);
+
+// Recycles Matrix storage instead of freeing it. Requests are rounded up to a
+// size class, four per power of two (at most 25% slack), and a released
+// buffer is kept for the next request of its class, alignment and pages, up
+// to max_cached_bytes in total. Matrices draw from a pool through
+// Allocator::pool, or from the pool of the innermost Scope on their thread
+// when they have no allocator, which covers the factories and the free
+// functions below. A pool lives until its last buffer is returned.
+// Thread-safe.
+class BufferPool {
+public:
+    struct Stats {
+        std::size_t hits = 0, misses = 0;
+        std::size_t cached_bytes = 0; // free buffers held
+    };
+
+    static std::shared_ptr<BufferPool> create(std::size_t max_cached_bytes = std::size_t(1) << 30);
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // At least bytes; fresh is false for a recycled buffer
+    void* acquire(std::size_t bytes, std::size_t alignment, Pages pages, bool& fresh);
+    void release(void* storage);
+    // Frees the cached buffers
+    void trim();
+    Stats stats() const;
+
+    static std::size_t size_class(std::size_t bytes);
+
+    // Makes pool the current one of this thread until the end of the scope.
+    class Scope {
+    public:
+        explicit Scope(std::shared_ptr<BufferPool> pool);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        std::shared_ptr<BufferPool> previous;
+    };
+    // nullptr outside any Scope
+    static const std::shared_ptr<BufferPool>& current();
+
+private:
+    explicit BufferPool(std::size_t max_cached_bytes);
+
+    struct Block {
+        std::size_t bytes, alignment;
+        Pages pages;
+        std::size_t mapped;
+    };
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+    std::size_t max_cached_bytes;
+};
+
+// Runs body(begin, end) over ranges covering [0, n), possibly on several
+// threads, e.g. parallel::ThreadPool::parallel_for.
+using ParallelFor = std::function<void(std::size_t n, const std::function<void(std::size_t, std::size_t)>& body)>;
+
+// How a Matrix gets its memory; copy() and similar() use the same. Huge pages
+// are Linux only and left to the default elsewhere. With first_touch set, a
+// new allocation is zeroed in bands of the outermost axis, first_touch(n,
+// body) calling body(begin, end) for each band on the thread that will work
+// on those rows (e.g. parallel::ThreadPool::parallel_for). Under Linux's
+// first-touch NUMA policy each band's pages then land on its worker's node;
+// recycled buffers from a pool keep the pages they have.
+struct Allocator {
+    Pages pages = Pages::normal;
+    ParallelFor first_touch = {};
+    std::shared_ptr<BufferPool> pool = {}; // BufferPool::current() if unset
+};
+
 template <typename T, int N>
 struct Matrix {
-    using Shape = std::array<uint16_t, N>;
+    using Shape = std::array<uint32_t, N>;
     using Stride = std::array<std::size_t, N>;
     using Position = Shape;
 
@@ -33,29 +138,91 @@ struct Matrix {
         return size;
     }
 
+    // bytes of the whole allocation, ghost cells included
     size_t total_bytes() const {
-        return total_size() * sizeof(T);
+        return allocated_size() * sizeof(T);
+    }
+
+    size_t allocated_size() const {
+        if (shape[0] == 0) return 0;
+        if constexpr (N == 1) return row_pitch(shape[0], layout);
+        return strides[0] * (shape[0] + 2 * layout.halo);
+    }
+
+    bool is_contiguous() const {
+        return allocated_size() == total_size();
+    }
+
+    void init_strides() {
+        strides = make_strides(shape, layout);
+        origin = row_lead(layout);
+        for (size_t d = 0; d + 1 < N; ++d) origin += layout.halo * strides[d];
     }
 
     void allocate() {
-        data.reset(static_cast<T*>(_aligned_alloc_(64, total_bytes())));
+        init_strides();
+        // with padded rows a kernel may read one vector past the last row
+        const size_t alignment = std::max<size_t>(64, layout.row_align);
+        const size_t bytes = round_up(total_bytes() + layout.row_align, alignment);
+        const Pages pages = allocator ? allocator->pages : Pages::normal;
+        const auto& pool = allocator && allocator->pool ? allocator->pool : BufferPool::current();
+        size_t mapped = 0;
+        bool fresh = true;
+        T* storage = static_cast<T*>(pool ? pool->acquire(bytes, alignment, pages, fresh)
+                                          : allocate_storage(bytes, alignment, pages, mapped));
+        data = std::unique_ptr<T[], Deleter>(storage, Deleter{nullptr, mapped, pool});
+        if (storage && fresh && allocator && allocator->first_touch) touch_bands(bytes);
+    }
+
+    // Zeroes the allocation band by band of outermost rows, as first_touch
+    // splits them; ghost rows and padding go with the first and last band.
+    void touch_bands(size_t bytes) {
+        auto* base = reinterpret_cast<unsigned char*>(data.get());
+        if constexpr (N == 1) {
+            std::fill_n(base, bytes, 0);
+        } else {
+            const size_t rows = shape[0], slab = strides[0] * sizeof(T);
+            auto boundary = [&](size_t r) { return r == 0 ? 0 : r == rows ? bytes : (layout.halo + r) * slab; };
+            allocator->first_touch(rows, [&](size_t b, size_t e) {
+                std::fill(base + boundary(b), base + boundary(e), 0);
+            });
+        }
     }
 
-    std::array<std::size_t, N> make_row_major_strides(const Shape& shape) const {
-        std::array<std::size_t, N> s{};
+    static size_t round_up(size_t n, size_t multiple) {
+        return (n + multiple - 1) / multiple * multiple;
+    }
+
+    // elements in front of column 0: the halo, rounded up to the row alignment
+    static size_t row_lead(const Layout& layout) {
+        if (layout.row_align == 0) return layout.halo;
+        return round_up(layout.halo, layout.row_align / sizeof(T));
+    }
+
+    static size_t row_pitch(size_t cols, const Layout& layout) {
+        if (layout.row_align == 0) return cols + 2 * layout.halo;
+        return round_up(row_lead(layout) + cols + layout.halo, layout.row_align / sizeof(T));
+    }
+
+    static Stride make_strides(const Shape& shape, const Layout& layout) {
+        Stride s{};
         std::size_t acc = 1;
-        for (std::size_t d = N; d-- > 0; ) { s[d] = acc; acc *= shape[d]; }
+        for (std::size_t d = N; d-- > 0; ) {
+            s[d] = acc;
+            acc *= d == N - 1 ? row_pitch(shape[d], layout) : shape[d] + 2 * layout.halo;
+        }
         return s;
     }
 
-    explicit Matrix(const Shape& shape) : shape(shape)
+    explicit Matrix(const Shape& shape, const Layout& layout = {}, std::shared_ptr<const Allocator> allocator = {})
+        : shape(shape), layout(layout), allocator(std::move(allocator))
     {
         allocate();
     }
 
     template <typename... Dims>
     explicit Matrix(Dims... dims) 
-        : shape{{static_cast<uint16_t>(dims)...}}
+        : shape{{static_cast<uint32_t>(dims)...}}
     {
         allocate();
     }
@@ -64,30 +231,52 @@ struct Matrix {
         // No need to free data, unique_ptr will handle it
     }
 
-    static Matrix<T, N> empty(Shape shape) {
-        return Matrix<T,N>(shape);
+    static Matrix<T, N> empty(Shape shape, const Layout& layout = {},
+                              std::shared_ptr<const Allocator> allocator = {}) {
+        return Matrix<T,N>(shape, layout, std::move(allocator));
     }
 
-    static Matrix<T, N> zeros(Shape shape) {
-        return Matrix<T,N>::from_value(shape, T(0));
+    static Matrix<T, N> zeros(Shape shape, const Layout& layout = {},
+                              std::shared_ptr<const Allocator> allocator = {}) {
+        return Matrix<T,N>::from_value(shape, T(0), layout, std::move(allocator));
     }
 
-    static Matrix<T, N> ones(Shape shape) {
-        return Matrix<T,N>::from_value(shape, T(1));
+    static Matrix<T, N> ones(Shape shape, const Layout& layout = {},
+                             std::shared_ptr<const Allocator> allocator = {}) {
+        return Matrix<T,N>::from_value(shape, T(1), layout, std::move(allocator));
     }
 
-    static Matrix<T, N> from_value(Shape shape, T value) {
-        auto m = Matrix<T,N>(shape);
-        std::fill_n(m.data.get(), m.total_size(), value);
+    // Wraps storage laid out as allocate() lays it out: total_bytes() plus
+    // row_align bytes, aligned to max(64, row_align). The memory is not freed;
+    // owner is released with the matrix instead.
+    static Matrix<T, N> from_storage(T* storage, const Shape& shape, const Layout& layout,
+                                     std::shared_ptr<void> owner) {
+        Matrix<T, N> m;
+        m.shape = shape;
+        m.layout = layout;
+        m.init_strides();
+        m.data = std::unique_ptr<T[], Deleter>(storage, Deleter{std::move(owner), 0, nullptr});
         return m;
     }
 
+    static Matrix<T, N> from_value(Shape shape, T value, const Layout& layout = {},
+                                   std::shared_ptr<const Allocator> allocator = {}) {
+        auto m = Matrix<T,N>(shape, layout, std::move(allocator));
+        m.fill(value);
+        return m;
+    }
+
+    // fills ghost cells as well, a constant field is its own periodic image
     void fill(T value){
-        std::fill_n(data.get(), total_size(), value);
+        std::fill_n(data.get(), allocated_size(), value);
     }
 
     Matrix(Matrix&& other) noexcept 
-        : shape(other.shape), 
+        : shape(other.shape),
+        layout(other.layout),
+        strides(other.strides),
+        origin(other.origin),
+        allocator(std::move(other.allocator)),
         data(std::move(other.data)) {
         other.shape.fill(0);
     }
@@ -96,6 +285,10 @@ struct Matrix {
         if (this != &other) {
             data = std::move(other.data);
             shape = other.shape;
+            layout = other.layout;
+            strides = other.strides;
+            origin = other.origin;
+            allocator = std::move(other.allocator);
             other.shape.fill(0);
         }
         return *this;
@@ -105,19 +298,39 @@ struct Matrix {
 
     Matrix& operator=(const Matrix&) = delete;
 
+    // Number of innermost rows, and the offset of row r from get_data().
+    // Together they walk the logical elements of any layout row by row.
+    size_t row_count() const {
+        return shape[N-1] == 0 ? 0 : total_size() / shape[N-1];
+    }
+
+    size_t row_offset(size_t r) const {
+        size_t offset = 0;
+        for (size_t d = N - 1; d-- > 0; ) {
+            offset += (r % shape[d]) * strides[d];
+            r /= shape[d];
+        }
+        return offset;
+    }
+
     bool operator==(const Matrix& other) const {
         if (shape != other.shape) return false;
+        auto equal_rows = [&](auto eq) {
+            if (is_contiguous() && other.is_contiguous()) {
+                return std::equal(get_data(), get_data() + total_size(), other.get_data(), eq);
+            }
+            for (size_t r = 0; r < row_count(); ++r) {
+                const T* a = get_data() + row_offset(r);
+                if (!std::equal(a, a + shape[N-1], other.get_data() + other.row_offset(r), eq)) return false;
+            }
+            return true;
+        };
         if constexpr (std::is_floating_point_v<T>) {
             constexpr T eps = static_cast<T>(1e-6); // or configurable
-            return std::equal(
-                data.get(), data.get() + total_size(), other.data.get(),
-                [eps](T a, T b) { return std::fabs(a - b) <= eps; }
-            );
+            return equal_rows([eps](T a, T b) { return std::fabs(a - b) <= eps; });
         } else {
             // exact comparison for integers, bool, etc.
-            return std::equal(
-                data.get(), data.get() + total_size(), other.data.get()
-            );
+            return equal_rows(std::equal_to<T>{});
         }
     }
 
@@ -126,61 +339,83 @@ struct Matrix {
     }
 
     Matrix copy() const {
-        Matrix<T, N> m(shape);
+        Matrix<T, N> m(shape, layout, allocator);
         auto ptr = data.get();
-        std::copy(ptr, ptr + total_size(), m.data.get());
+        std::copy(ptr, ptr + allocated_size(), m.data.get());
         return m;
     }
     
     Matrix similar() const {
-        return Matrix<T, N>::empty(shape);
+        return Matrix<T, N>::empty(shape, layout, allocator);
     }
 
-    static size_t offset(const Shape& shape, const Position& pos) {
-        size_t offset = 0;
-        size_t stride = 1;
-        for (int i = N - 1; i >= 0; --i) {
-            offset += pos[i] * stride;
-            stride *= shape[i];
+    // Copies the opposite edges into the ghost ring so that the matrix wraps
+    // around like a torus. O(perimeter); corners come from the row copies,
+    // which already include the refreshed ghost columns.
+    void refresh_halo() requires (N == 2) {
+        const std::ptrdiff_t h = layout.halo;
+        const std::ptrdiff_t rows = shape[0], cols = shape[1];
+        const std::ptrdiff_t pitch = strides[0];
+        assert(h <= rows && h <= cols);
+        if (h == 0) return;
+        T* p = get_data();
+        for (std::ptrdiff_t r = 0; r < rows; ++r) {
+            T* row = p + r * pitch;
+            std::copy(row + cols - h, row + cols, row - h);
+            std::copy(row, row + h, row + cols);
+        }
+        for (std::ptrdiff_t k = 1; k <= h; ++k) {
+            std::copy_n(p + (rows - k) * pitch - h, cols + 2 * h, p - k * pitch - h);
+            std::copy_n(p + (k - 1) * pitch - h, cols + 2 * h, p + (rows + k - 1) * pitch - h);
         }
-        return offset;
+    }
+
+    size_t offset(const Position& pos) const {
+        return [&]<std::size_t... d>(std::index_sequence<d...>) {
+            return ((pos[d] * strides[d]) + ...);
+        }(std::make_index_sequence<N>{});
     }
     
     T& operator()(Position pos) {
-        return data[offset(shape, pos)];
+        return get_data()[offset(pos)];
     }
     
     const T& operator()(Position pos) const {
-        return data[offset(shape, pos)];
+        return get_data()[offset(pos)];
+    }
+
+    // m(i, j): one multiply-add per axis, no arrays built
+    template <std::integral... I> requires (sizeof...(I) == N)
+    T& operator()(I... i) {
+        return view()(i...);
+    }
+
+    template <std::integral... I> requires (sizeof...(I) == N)
+    const T& operator()(I... i) const {
+        return view()(i...);
+    }
+
+    // First element of row i of a rank 2 matrix; the row's cells follow
+    // contiguously, ghost cells at negative offsets
+    T* row(std::size_t i) requires (N == 2) {
+        return get_data() + i * strides[0];
+    }
+
+    const T* row(std::size_t i) const requires (N == 2) {
+        return get_data() + i * strides[0];
     }
     
     View<T, N-1> operator[](std::size_t i) const {
         static_assert(N >= 2, "Use View<T,1> directly for rank-1.");
-        assert(i < shape[0]);
-        View<T, N-1> v{};
-        auto stride = make_row_major_strides(shape);
-        v.ptr = data.get() + i * stride[0];
-        for (std::size_t d = 1; d < N; ++d) {
-            v.shape[d-1]  = shape[d];
-            v.stride[d-1] = stride[d];
-        }
-        return v;
+        return View<T, N>{const_cast<T*>(get_data()), shape, strides}[i];
     }
 
     View<T, N> view() {
-        View<T, N> v{};
-        v.ptr = data.get();
-        v.shape = shape;
-        v.stride = make_row_major_strides(shape);
-        return v;
+        return {get_data(), shape, strides};
     }
 
     View<const T, N> view() const {
-        View<const T, N> v{};
-        v.ptr = data.get();
-        v.shape = shape;
-        v.stride = make_row_major_strides(shape);
-        return v;
+        return {get_data(), shape, strides};
     }
 
     constexpr size_t get_ndims() const {
@@ -190,24 +425,55 @@ struct Matrix {
     const Shape& get_shape() const {
         return shape;
     }
+
+    const Stride& get_strides() const {
+        return strides;
+    }
+
+    const Layout& get_layout() const {
+        return layout;
+    }
+
+    // nullptr for the default allocator
+    const std::shared_ptr<const Allocator>& get_allocator() const {
+        return allocator;
+    }
     
     const T* get_data() const {
-        return data.get();
+        return data.get() + origin;
     }
 
     T* get_data() {
+        return data.get() + origin;
+    }
+
+    // start of the allocation, get_data() - get_origin()
+    const T* get_storage() const {
         return data.get();
     }
 
+    size_t get_origin() const {
+        return origin;
+    }
+
     typedef T value_type;
 
 protected:
     struct Deleter {
+        std::shared_ptr<void> owner; // set for storage from from_storage()
+        size_t mapped = 0;
+        std::shared_ptr<BufferPool> pool; // set for recycled storage
         void operator()(T* ptr) {
-            _aligned_free_(ptr);
+            if (owner) owner.reset();
+            else if (pool) pool->release(ptr);
+            else free_storage(ptr, mapped);
         }
     };
     Shape shape;
+    Layout layout;
+    Stride strides{};
+    size_t origin = 0;
+    std::shared_ptr<const Allocator> allocator;
     std::unique_ptr<T[], Deleter> data {nullptr};
 };
 
@@ -216,7 +482,7 @@ auto empty(Dims... dims)
 {
     constexpr size_t N = sizeof...(Dims);
     using Mat = Matrix<T, N>;
-    return Mat::empty(typename Mat::Shape{static_cast<uint16_t>(dims)...});
+    return Mat::empty(typename Mat::Shape{static_cast<uint32_t>(dims)...});
 }
 
 template <typename T, typename... Dims>
@@ -225,7 +491,7 @@ auto zeros(Dims... dims)
 {
     constexpr size_t N = sizeof...(Dims);
     using Mat = Matrix<T, N>;
-    return Mat::zeros(typename Mat::Shape{static_cast<uint16_t>(dims)...});
+    return Mat::zeros(typename Mat::Shape{static_cast<uint32_t>(dims)...});
 }
 
 template <typename T, typename... Dims>
@@ -233,7 +499,7 @@ auto ones(Dims... dims)
 {
     constexpr size_t N = sizeof...(Dims);
     using Mat = Matrix<T, N>;
-    return Mat::ones(typename Mat::Shape{static_cast<uint16_t>(dims)...});
+    return Mat::ones(typename Mat::Shape{static_cast<uint32_t>(dims)...});
 }
 
 template <typename T, typename... Dims>
@@ -241,20 +507,37 @@ auto from_value(T value, Dims... dims)
 {
     constexpr size_t N = sizeof...(Dims);
     using Mat = Matrix<T, N>;
-    return Mat::from_value(typename Mat::Shape{static_cast<uint16_t>(dims)...}, value);
+    return Mat::from_value(typename Mat::Shape{static_cast<uint32_t>(dims)...}, value);
 }
 
 template <typename T, int N>
 Matrix<T, N> similar(const Matrix<T, N>& mat) {
-    return Matrix<T, N>::empty(mat.get_shape());
+    return mat.similar();
+}
+
+template <typename T, typename Shape>
+auto zeros(const Shape& shape, const Layout& layout = {}) {
+    constexpr size_t N = std::tuple_size_v<Shape>;
+    return Matrix<T, N>::zeros(shape, layout);
 }
 
 template <typename T, typename Shape>
-auto zeros(const Shape& shape) {
+auto ones(const Shape& shape, const Layout& layout = {}) {
     constexpr size_t N = std::tuple_size_v<Shape>;
-    return Matrix<T, N>::zeros(shape);
+    return Matrix<T, N>::ones(shape, layout);
 }
 
+// Uniform [0, 1) and standard normal samples from eight xoshiro256++
+// generators stepped together in SIMD (GrayScott::kernels::Kernels::uniform
+// and normal). With a seed the values depend on the seed alone: each block of
+// rng_block elements draws from its own jump() substreams, and the blocks are
+// filled through parallel_for when one is given. Without, the seed comes from
+// the TSC.
+inline constexpr size_t rng_block = size_t(1) << 20;
+
+template <typename T>
+void randu(T* data, size_t size, uint64_t seed, const ParallelFor& parallel_for = {});
+
 template <typename T>
 void randu(T* data, size_t size);
 
@@ -262,11 +545,14 @@ template <typename T, typename... Dims>
 auto randu(Dims... dims) {
     constexpr size_t N = sizeof...(Dims);
     using Mat = Matrix<T, N>;
-    auto m = Mat::empty(typename Mat::Shape{static_cast<uint16_t>(dims)...});
+    auto m = Mat::empty(typename Mat::Shape{static_cast<uint32_t>(dims)...});
     randu(m.get_data(), m.total_size());
     return m;
 }
 
+template <typename T>
+void randn(T* data, size_t size, uint64_t seed, const ParallelFor& parallel_for = {});
+
 template <typename T>
 void randn(T* data, size_t size);
 
@@ -274,39 +560,82 @@ template <typename T, typename... Dims>
 auto randn(Dims... dims) {
     constexpr size_t N = sizeof...(Dims);
     using Mat = Matrix<T, N>;
-    auto m = Mat::empty(typename Mat::Shape{static_cast<uint16_t>(dims)...});
+    auto m = Mat::empty(typename Mat::Shape{static_cast<uint32_t>(dims)...});
     randn(m.get_data(), m.total_size());
     return m;
 }
 
+// Non-owning strided view. Indexing is constant time with no loops:
+// v(i, j) is one multiply-add per axis, v.row(i) the pointer to a row of a
+// rank 2 view (contiguous, as in every Matrix), and v.rows() iterates the
+// rows as spans. v[i][j] still works, building a View one rank down per index.
 template <typename T>
 struct View<T, 1> {
     T* ptr{};
-    std::array<std::size_t, 1> shape{};
+    std::array<uint32_t, 1> shape{};
     std::array<std::size_t, 1> stride{1};
 
     inline T& operator[](std::size_t i) const {   
         return ptr[i];
     }
+
+    inline T& operator()(std::size_t i) const {
+        return ptr[i];
+    }
+
+    std::span<T> span() const {
+        return {ptr, shape[0]};
+    }
 };
 
 template <typename T, std::size_t N>
 struct View {
     static_assert(N >= 2, "N must be >= 2 here");
     T* ptr{};
-    typename Matrix<T, N>::Shape shape{};
+    std::array<uint32_t, N> shape{};
     std::array<std::size_t, N> stride{};
 
     inline View<T, N-1> operator[](std::size_t i) const {
         assert(i < shape[0]);
-        View<T, N-1> v{};
-        v.ptr = ptr + i * stride[0];
-        // shift shape/stride left by one
-        for (std::size_t d = 1; d < N; ++d) {
-            v.shape[d-1]  = shape[d];
-            v.stride[d-1] = stride[d];
-        }
-        return v;
+        // shape and stride without their first axis
+        return [&]<std::size_t... d>(std::index_sequence<d...>) {
+            return View<T, N-1>{ptr + i * stride[0], {shape[d + 1]...}, {stride[d + 1]...}};
+        }(std::make_index_sequence<N - 1>{});
+    }
+
+    template <std::integral... I> requires (sizeof...(I) == N)
+    inline T& operator()(I... i) const {
+        return [&]<std::size_t... d>(std::index_sequence<d...>) -> T& {
+            return ptr[((std::size_t(i) * stride[d]) + ...)];
+        }(std::make_index_sequence<N>{});
+    }
+
+    inline T* row(std::size_t i) const requires (N == 2) {
+        assert(i < shape[0] && stride[1] == 1);
+        return ptr + i * stride[0];
+    }
+
+    // The rows of a rank 2 view as std::span, for range-for
+    struct RowIterator {
+        using value_type = std::span<T>;
+        using difference_type = std::ptrdiff_t;
+        T* p;
+        std::size_t pitch, cols;
+
+        std::span<T> operator*() const { return {p, cols}; }
+        RowIterator& operator++() { p += pitch; return *this; }
+        RowIterator operator++(int) { RowIterator it = *this; p += pitch; return it; }
+        bool operator==(const RowIterator& other) const { return p == other.p; }
+    };
+
+    struct Rows {
+        RowIterator first, last;
+        RowIterator begin() const { return first; }
+        RowIterator end() const { return last; }
+    };
+
+    Rows rows() const requires (N == 2) {
+        return {{ptr, stride[0], shape[1]}, {ptr + shape[0] * stride[0], stride[0], shape[1]}};
     }
 };
 
@@ -315,14 +644,17 @@ template <typename T, int N>
 bool almost_equal(const Matrix<T,N>& a, const Matrix<T,N>& b, T abs_eps = static_cast<T>(1e-6), T rel_eps = static_cast<T>(1e-5)) {
     if (a.get_shape() != b.get_shape()) return false;
     if constexpr (std::is_floating_point_v<T>) {
-        return std::equal(
-            a.get_data(), a.get_data() + a.total_size(), b.get_data(),
-            [abs_eps, rel_eps](T a, T b) {
-                const T diff = std::fabs(a - b);
-                const T tol = abs_eps + rel_eps * std::max(std::fabs(a), std::fabs(b));
-                return diff <= tol;
-            }
-        );
+        auto close = [abs_eps, rel_eps](T a, T b) {
+            const T diff = std::fabs(a - b);
+            const T tol = abs_eps + rel_eps * std::max(std::fabs(a), std::fabs(b));
+            return diff <= tol;
+        };
+        const size_t n = a.get_shape()[N-1];
+        for (size_t r = 0; r < a.row_count(); ++r) {
+            const T* ra = a.get_data() + a.row_offset(r);
+            if (!std::equal(ra, ra + n, b.get_data() + b.row_offset(r), close)) return false;
+        }
+        return true;
     } else {
         // exact comparison for integers, bool, etc.
         return std::equal(
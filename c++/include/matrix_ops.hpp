@@ -1,9 +1,277 @@
+#pragma once
 #include <matrix.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
 
 namespace matrix::ops {
 
 using matrix::Matrix;
 void conv3x3_f32(const Matrix<float,2>& input, const Matrix<float,2>& kernel, Matrix<float,2>& output);
+// needs a CPU with AVX2 and FMA
 void conv3x3_f32_avx2(const Matrix<float,2>& input, const Matrix<float,2>& kernel, Matrix<float,2>& output);
+// needs a CPU with AVX-512F
+void conv3x3_f32_avx512(const Matrix<float,2>& input, const Matrix<float,2>& kernel, Matrix<float,2>& output);
 
 } // namespace matrix::ops
+
+// Lazy elementwise arithmetic over rank 1 and 2 Matrix and View operands.
+// An expression such as U + (Du * L - U * V * V + F * (1.0f - U)) * dt only
+// builds a tree of small structs holding data pointers and scalars; assign()
+// evaluates it in a single pass, row by row, with the inner loop running over
+// contiguous columns so the compiler vectorises it. No temporaries are
+// allocated, and each operand is read once per cell. Operands must have the
+// shape of the destination, which may also appear in the expression.
+// Expressions point into their operands, so evaluate them while the operands
+// are alive, typically in the statement that builds them.
+namespace matrix::expr {
+
+// Rows of a Matrix or View, cols contiguous elements pitch apart
+template <typename T>
+struct Leaf {
+    using value_type = T;
+    const T* data;
+    std::ptrdiff_t pitch;
+    std::size_t rows, cols;
+
+    struct Row {
+        const T* p;
+        T operator[](std::size_t j) const { return p[j]; }
+    };
+    Row row(std::size_t i) const { return {data + std::ptrdiff_t(i) * pitch}; }
+    bool fits(std::size_t r, std::size_t c) const { return rows == r && cols == c; }
+};
+
+// A scalar broadcast to every cell
+template <typename T>
+struct Scalar {
+    using value_type = T;
+    T value;
+
+    struct Row {
+        T value;
+        T operator[](std::size_t) const { return value; }
+    };
+    Row row(std::size_t) const { return {value}; }
+    bool fits(std::size_t, std::size_t) const { return true; }
+};
+
+template <typename Op, typename A>
+struct Unary {
+    using value_type = decltype(Op{}(std::declval<typename A::value_type>()));
+    A a;
+
+    struct Row {
+        typename A::Row a;
+        value_type operator[](std::size_t j) const { return Op{}(a[j]); }
+    };
+    Row row(std::size_t i) const { return {a.row(i)}; }
+    bool fits(std::size_t r, std::size_t c) const { return a.fits(r, c); }
+};
+
+template <typename Op, typename A, typename B>
+struct Binary {
+    using value_type = decltype(Op{}(std::declval<typename A::value_type>(), std::declval<typename B::value_type>()));
+    A a;
+    B b;
+
+    struct Row {
+        typename A::Row a;
+        typename B::Row b;
+        value_type operator[](std::size_t j) const { return Op{}(a[j], b[j]); }
+    };
+    Row row(std::size_t i) const { return {a.row(i), b.row(i)}; }
+    bool fits(std::size_t r, std::size_t c) const { return a.fits(r, c) && b.fits(r, c); }
+};
+
+template <typename Op, typename A, typename B, typename C>
+struct Ternary {
+    using value_type = decltype(Op{}(std::declval<typename A::value_type>(), std::declval<typename B::value_type>(),
+                                     std::declval<typename C::value_type>()));
+    A a;
+    B b;
+    C c;
+
+    struct Row {
+        typename A::Row a;
+        typename B::Row b;
+        typename C::Row c;
+        value_type operator[](std::size_t j) const { return Op{}(a[j], b[j], c[j]); }
+    };
+    Row row(std::size_t i) const { return {a.row(i), b.row(i), c.row(i)}; }
+    bool fits(std::size_t r, std::size_t c_) const { return a.fits(r, c_) && b.fits(r, c_) && c.fits(r, c_); }
+};
+
+struct Neg { template <typename X> auto operator()(X x) const { return -x; } };
+struct Add { template <typename X, typename Y> auto operator()(X x, Y y) const { return x + y; } };
+struct Sub { template <typename X, typename Y> auto operator()(X x, Y y) const { return x - y; } };
+struct Mul { template <typename X, typename Y> auto operator()(X x, Y y) const { return x * y; } };
+struct Div { template <typename X, typename Y> auto operator()(X x, Y y) const { return x / y; } };
+// in the form that compiles to minps / maxps
+struct Min { template <typename X> X operator()(X x, X y) const { return y < x ? y : x; } };
+struct Max { template <typename X> X operator()(X x, X y) const { return x < y ? y : x; } };
+// x * y + z, contracted to an FMA where the build allows it
+struct Fma { template <typename X> X operator()(X x, X y, X z) const { return x * y + z; } };
+struct Clamp { template <typename X> X operator()(X x, X lo, X hi) const { return Min{}(Max{}(x, lo), hi); } };
+
+template <typename E> struct is_node : std::false_type {};
+template <typename T> struct is_node<Leaf<T>> : std::true_type {};
+template <typename T> struct is_node<Scalar<T>> : std::true_type {};
+template <typename Op, typename A> struct is_node<Unary<Op, A>> : std::true_type {};
+template <typename Op, typename A, typename B> struct is_node<Binary<Op, A, B>> : std::true_type {};
+template <typename Op, typename A, typename B, typename C> struct is_node<Ternary<Op, A, B, C>> : std::true_type {};
+
+template <typename X> struct is_array : std::false_type {};
+template <typename T, int N> struct is_array<Matrix<T, N>> : std::bool_constant<(N <= 2)> {};
+template <typename T, std::size_t N> struct is_array<View<T, N>> : std::bool_constant<(N <= 2)> {};
+
+// A Matrix, View or expression; plain numbers only mix with these
+template <typename X>
+concept Operand = is_node<std::remove_cvref_t<X>>::value || is_array<std::remove_cvref_t<X>>::value;
+
+template <typename X>
+concept Argument = Operand<X> || std::is_arithmetic_v<std::remove_cvref_t<X>>;
+
+template <typename T, int N>
+Leaf<T> leaf(const Matrix<T, N>& m)
+{
+    const std::size_t cols = m.get_shape()[N - 1];
+    if constexpr (N == 1) return {m.get_data(), 0, 1, cols};
+    else return {m.get_data(), std::ptrdiff_t(m.get_strides()[0]), m.get_shape()[0], cols};
+}
+
+template <typename T, std::size_t N>
+Leaf<std::remove_const_t<T>> leaf(const View<T, N>& v)
+{
+    assert(v.stride[N - 1] == 1);
+    if constexpr (N == 1) return {v.ptr, 0, 1, v.shape[0]};
+    else return {v.ptr, std::ptrdiff_t(v.stride[0]), v.shape[0], v.shape[1]};
+}
+
+// x as an expression node; numbers become Scalars of type T
+template <typename T, typename X>
+auto node(const X& x)
+{
+    if constexpr (is_node<X>::value) return x;
+    else if constexpr (is_array<X>::value) return leaf(x);
+    else return Scalar<T>{T(x)};
+}
+
+template <typename X>
+struct value_of {
+    using type = typename decltype(node<int>(std::declval<const X&>()))::value_type;
+};
+
+// The element type of the first Matrix, View or expression among X...
+template <typename... X>
+struct first_value;
+
+template <typename X, typename... Rest>
+struct first_value<X, Rest...> {
+    using type = typename std::conditional_t<Operand<X>, value_of<X>, first_value<Rest...>>::type;
+};
+
+template <typename Op, typename... X>
+auto make(const X&... x)
+{
+    using T = typename first_value<X...>::type;
+    if constexpr (sizeof...(X) == 1) return Unary<Op, decltype(node<T>(x))...>{node<T>(x)...};
+    else if constexpr (sizeof...(X) == 2) return Binary<Op, decltype(node<T>(x))...>{node<T>(x)...};
+    else return Ternary<Op, decltype(node<T>(x))...>{node<T>(x)...};
+}
+
+template <Operand A>
+auto operator-(const A& a) { return make<Neg>(a); }
+
+template <Argument A, Argument B> requires (Operand<A> || Operand<B>)
+auto operator+(const A& a, const B& b) { return make<Add>(a, b); }
+
+template <Argument A, Argument B> requires (Operand<A> || Operand<B>)
+auto operator-(const A& a, const B& b) { return make<Sub>(a, b); }
+
+template <Argument A, Argument B> requires (Operand<A> || Operand<B>)
+auto operator*(const A& a, const B& b) { return make<Mul>(a, b); }
+
+template <Argument A, Argument B> requires (Operand<A> || Operand<B>)
+auto operator/(const A& a, const B& b) { return make<Div>(a, b); }
+
+template <Argument A, Argument B> requires (Operand<A> || Operand<B>)
+auto min(const A& a, const B& b) { return make<Min>(a, b); }
+
+template <Argument A, Argument B> requires (Operand<A> || Operand<B>)
+auto max(const A& a, const B& b) { return make<Max>(a, b); }
+
+// a * b + c
+template <Argument A, Argument B, Argument C> requires (Operand<A> || Operand<B> || Operand<C>)
+auto fma(const A& a, const B& b, const C& c) { return make<Fma>(a, b, c); }
+
+template <Argument A, Argument B, Argument C> requires Operand<A>
+auto clamp(const A& a, const B& lo, const C& hi) { return make<Clamp>(a, lo, hi); }
+
+// Destination rows
+template <typename T>
+struct Target {
+    T* data;
+    std::ptrdiff_t pitch;
+    std::size_t rows, cols;
+};
+
+template <typename T, int N>
+Target<T> target(Matrix<T, N>& m)
+{
+    const Leaf<T> l = leaf(m);
+    return {m.get_data(), l.pitch, l.rows, l.cols};
+}
+
+template <typename T, std::size_t N>
+Target<T> target(const View<T, N>& v)
+{
+    const Leaf<T> l = leaf(v);
+    return {v.ptr, l.pitch, l.rows, l.cols};
+}
+
+template <typename T, typename E>
+void evaluate(const Target<T>& dst, const E& e, std::size_t row_begin, std::size_t row_end)
+{
+    const auto x = node<T>(e);
+    assert(x.fits(dst.rows, dst.cols));
+    for (std::size_t i = row_begin; i < row_end; ++i) {
+        T* out = dst.data + std::ptrdiff_t(i) * dst.pitch;
+        const auto r = x.row(i);
+        for (std::size_t j = 0; j < dst.cols; ++j) out[j] = T(r[j]);
+    }
+}
+
+} // namespace matrix::expr
+
+namespace matrix {
+
+using expr::operator+;
+using expr::operator-;
+using expr::operator*;
+using expr::operator/;
+using expr::min;
+using expr::max;
+using expr::fma;
+using expr::clamp;
+
+// dst = e over rows [row_begin, row_end) of dst (its only row for rank 1),
+// e.g. for a caller that splits the rows between threads itself
+template <typename Dst, expr::Argument E>
+void assign_rows(Dst&& dst, const E& e, std::size_t row_begin, std::size_t row_end)
+{
+    expr::evaluate(expr::target(dst), e, row_begin, row_end);
+}
+
+// dst = e, the rows spread over parallel_for when it is set
+template <typename Dst, expr::Argument E>
+void assign(Dst&& dst, const E& e, const ParallelFor& parallel_for = {})
+{
+    const auto t = expr::target(dst);
+    if (!parallel_for) return expr::evaluate(t, e, 0, t.rows);
+    parallel_for(t.rows, [&](std::size_t begin, std::size_t end) { expr::evaluate(t, e, begin, end); });
+}
+
+} // namespace matrix
@@ -0,0 +1,102 @@
+#pragma once
+#include <gray_scott.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace GrayScott {
+
+// Bounded single-producer/single-consumer ring of preallocated slots. The
+// producer never waits: try_acquire returns nullptr while the ring is full.
+// Each side owns one index, published with release and read with acquire.
+class FrameRing {
+public:
+    struct Slot {
+        std::unique_ptr<std::byte[], void (*)(std::byte*)> data{nullptr, nullptr};
+        uint64_t step = 0;
+    };
+
+    FrameRing(size_t n_slots, size_t slot_bytes);
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    // producer: the slot to fill next, or nullptr if the consumer is behind
+    Slot* try_acquire();
+    // blocks until the consumer frees a slot
+    Slot* wait_acquire();
+    void publish();
+
+    // consumer: the oldest published slot, or nullptr if there is none
+    Slot* try_front();
+    // blocks until a slot is published or close() is called
+    Slot* wait_front();
+    void release();
+
+    void close();
+    bool closed() const;
+
+private:
+    std::vector<Slot> slots;
+    // The closed flag is the top bit of head, so a consumer parked on head is
+    // woken by close() as well as by publish().
+    alignas(64) std::atomic<uint64_t> head{0}; // next slot the producer publishes
+    alignas(64) std::atomic<uint64_t> tail{0}; // next slot the consumer releases
+};
+
+// Runs the solver and the renderer on two threads. The calling thread steps
+// the backend and copies its front fields into a FrameRing slot every
+// `substeps` steps; a consumer thread colormaps each frame and hands it to the
+// sink. When the consumer falls behind the frame is dropped, the solver never
+// waits for it (unless Options::drop_frames is off). With Params::fps > 0 the
+// solver is paced to fps frames per second, otherwise it runs flat out.
+class Pipeline {
+public:
+    struct Options {
+        unsigned substeps = 1;  // steps per published frame
+        size_t ring_slots = 3;
+        OutputFormat format = OutputFormat::RGBA8;
+        size_t pitch = 0;       // output row pitch in bytes, 0 for tight rows
+        // false waits for a free slot instead, for offline output where every
+        // frame must arrive; the solver then only waits when the ring is full
+        bool drop_frames = true;
+    };
+
+    struct Stats {
+        uint64_t steps = 0;
+        uint64_t frames_published = 0;
+        uint64_t frames_dropped = 0;
+        uint64_t frames_rendered = 0;
+    };
+
+    // pixels, row pitch in bytes and the step the frame shows
+    using FrameSink = std::function<void(const uint8_t* pixels, size_t pitch, uint64_t step)>;
+
+    Pipeline(Backend& backend, const Params& params, const Colormap& colormap, const Options& options, FrameSink sink);
+
+    // Advances n_steps steps (rounded up to whole frames) or until stop().
+    Stats run(uint64_t n_steps);
+    // May be called from any thread, run() returns after the current frame.
+    void stop() { stop_requested.store(true, std::memory_order_relaxed); }
+
+private:
+    // false when the ring is full and the frame is dropped
+    bool publish_frame(FrameRing& ring, uint64_t step);
+    void consume(FrameRing& ring);
+
+    Backend& backend;
+    Params params;
+    Colormap colormap;
+    Options options;
+    FrameSink sink;
+    std::atomic<bool> stop_requested{false};
+    std::atomic<uint64_t> frames_rendered{0};
+    FieldView layout;   // shape and storage of the fields, the pointers are not used
+    size_t plane_bytes = 0;
+};
+
+} // namespace GrayScott
@@ -1,16 +1,101 @@
+#pragma once
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <thread>
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__x86_64__)
+#include <cpuid.h>
+#endif
+#ifdef __linux__
+#include <filesystem>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware event counts of one thread and of the threads it creates from
+// then on (perf inherit), so counters opened on the thread that later starts
+// a pool or a pipeline also cover its workers (Linux only). Counts are user
+// space from construction on, each event scaled up when the kernel had to
+// multiplex it. Unavailable on other platforms, in VMs without a virtual PMU
+// and when kernel.perf_event_paranoid forbids it; single events the PMU lacks
+// read 0.
+struct PerfCounters {
+    enum Event { cycles, instructions, l1d_misses, llc_misses, n_events };
+    using Reading = std::array<uint64_t, n_events>;
+    static constexpr const char* names[n_events] = {"cycles", "instructions", "l1d_misses", "llc_misses"};
+
+    // tid 0 is the calling thread
+    explicit PerfCounters(int tid = 0) {
+        fds.fill(-1);
+    #ifdef __linux__
+        const std::pair<uint32_t, uint64_t> events[n_events] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        };
+        for (int e = 0; e < n_events; ++e) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = events[e].first;
+            attr.config = events[e].second;
+            // inherited events cannot be read as a group, each is read alone
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[e] = int(syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+            if (fds[0] < 0) return;
+        }
+    #else
+        (void)tid;
+    #endif
+    }
+    ~PerfCounters() {
+    #ifdef __linux__
+        for (int fd : fds)
+            if (fd >= 0) close(fd);
+    #endif
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const { return fds[0] >= 0; }
+
+    // the thread's counts plus those of the threads it created
+    Reading read() const {
+        Reading r{};
+    #ifdef __linux__
+        for (int e = 0; e < n_events; ++e) {
+            // value, time enabled, time running
+            uint64_t buf[3];
+            if (fds[e] < 0 || ::read(fds[e], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0) continue;
+            r[e] = uint64_t(buf[0] * (double(buf[1]) / buf[2]));
+        }
+    #endif
+        return r;
+    }
+
+    private:
+    std::array<int, n_events> fds;
+};
 
 struct Profiler {
     using Measurements_t = std::map<std::string, std::vector<double>>;
     double cpu_freq;
     
     Profiler() {
-        cpu_freq = measure_cpu_frequency();
+        cpu_freq = tsc_frequency();
     }
     Profiler(double cpu_freq_) : cpu_freq(cpu_freq_) {}
 
@@ -31,6 +116,55 @@ struct Profiler {
     #endif
     }
 
+    // Ticks per second of read_cycles: enumerated by the CPU where it can
+    // (CPUID leaves 0x15/0x16 for the invariant TSC, CNTFRQ on ARM), otherwise
+    // measured once per process.
+    static double tsc_frequency() {
+        static const double freq = [] {
+            const double enumerated = enumerated_frequency();
+            return enumerated > 0 ? enumerated : measure_cpu_frequency();
+        }();
+        return freq;
+    }
+
+    static double enumerated_frequency() {
+    #if defined(_MSC_VER) || defined(__x86_64__)
+        unsigned r[4] = {};
+        auto cpuid = [&](unsigned leaf) {
+        #ifdef _MSC_VER
+            int regs[4];
+            __cpuidex(regs, int(leaf), 0);
+            std::memcpy(r, regs, sizeof(r));
+        #else
+            __cpuid_count(leaf, 0, r[0], r[1], r[2], r[3]);
+        #endif
+        };
+        cpuid(0);
+        const unsigned max_leaf = r[0];
+        cpuid(0x80000000);
+        if (r[0] < 0x80000007) return 0;
+        cpuid(0x80000007);
+        if (!(r[3] & (1u << 8))) return 0; // not invariant
+        if (max_leaf >= 0x15) {
+            // TSC / crystal ratio in ebx / eax, crystal Hz in ecx
+            cpuid(0x15);
+            if (r[0] && r[1] && r[2]) return double(r[2]) * r[1] / r[0];
+        }
+        if (max_leaf >= 0x16) {
+            // base MHz, the TSC rate where 0x15 leaves the crystal out
+            cpuid(0x16);
+            if (r[0]) return r[0] * 1e6;
+        }
+        return 0;
+    #elif defined(__aarch64__)
+        uint64_t val;
+        asm volatile("mrs %0, cntfrq_el0" : "=r"(val));
+        return double(val);
+    #else
+        return double(std::chrono::steady_clock::period::den) / std::chrono::steady_clock::period::num;
+    #endif
+    }
+
     static double measure_cpu_frequency() {
         auto start_time = std::chrono::steady_clock::now();
         uint64_t start_cycles = read_cycles();
@@ -57,6 +191,42 @@ struct Profiler {
         counters[key].push_back(value);
     }
 
+    // Counts hardware events in every Section from now on, over all threads
+    // of the process: PerfCounters on each thread running now, which also
+    // follow the threads those start later (pool workers, a pipeline's
+    // consumer). False if PerfCounters are unavailable here.
+    bool enable_perf_counters() {
+        perf.clear();
+        perf.push_back(std::make_unique<PerfCounters>());
+        if (!perf[0]->available()) {
+            perf.clear();
+            return false;
+        }
+    #ifdef __linux__
+        const auto self = std::to_string(syscall(SYS_gettid));
+        std::error_code ec;
+        for (const auto& task : std::filesystem::directory_iterator("/proc/self/task", ec)) {
+            const std::string tid = task.path().filename().string();
+            if (tid == self) continue;
+            // a thread that exited meanwhile is just left out
+            auto counters = std::make_unique<PerfCounters>(std::stoi(tid));
+            if (counters->available()) perf.push_back(std::move(counters));
+        }
+    #endif
+        return true;
+    }
+    bool perf_counters_enabled() const { return !perf.empty(); }
+
+    // Sum of the counts of every thread
+    PerfCounters::Reading read_perf_counters() const {
+        PerfCounters::Reading sum{};
+        for (const auto& counters : perf) {
+            const auto r = counters->read();
+            for (int e = 0; e < PerfCounters::n_events; ++e) sum[e] += r[e];
+        }
+        return sum;
+    }
+
     Measurements_t get_measurements(const char units[] = "us") const {
         Measurements_t result;
         auto scale = 1.0 / cpu_freq;
@@ -86,20 +256,60 @@ struct Profiler {
         return counters;
     }
 
+    // Per sample of each section with perf counters: "<name> ipc" and, for
+    // sections given a cell count, "<name> l1d_misses_per_cell",
+    // "<name> llc_bytes_per_cell" (LLC misses of 64-byte lines, roughly the
+    // DRAM traffic) and "<name> llc_gb_per_s". High IPC at few bytes per cell
+    // is compute-bound; GB/s near the machine's stream bandwidth is not.
+    Measurements_t get_perf_measurements() const {
+        Measurements_t result;
+        for (const auto& [name, samples] : perf_samples) {
+            for (const auto& s : samples) {
+                const auto& e = s.events;
+                if (e[PerfCounters::cycles])
+                    result[name + " ipc"].push_back(double(e[PerfCounters::instructions]) / e[PerfCounters::cycles]);
+                if (!s.cells) continue;
+                const double llc_bytes = 64.0 * e[PerfCounters::llc_misses];
+                result[name + " l1d_misses_per_cell"].push_back(double(e[PerfCounters::l1d_misses]) / s.cells);
+                result[name + " llc_bytes_per_cell"].push_back(llc_bytes / s.cells);
+                result[name + " llc_gb_per_s"].push_back(llc_bytes * 1e-9 * cpu_freq / s.tsc_cycles);
+            }
+        }
+        return result;
+    }
+
+    // cells: the work of the section, e.g. grid cells times steps, for the
+    // per-cell rates of get_perf_measurements
     struct Section {
         Profiler &profiler;
         std::string name;
+        uint64_t cells;
         uint64_t start_cycles;
-        Section(Profiler &profiler_, const std::string &name_)
-            : profiler(profiler_), name(name_) {
+        PerfCounters::Reading start_events{};
+        Section(Profiler &profiler_, const std::string &name_, uint64_t cells_ = 0)
+            : profiler(profiler_), name(name_), cells(cells_) {
+            if (profiler.perf_counters_enabled()) start_events = profiler.read_perf_counters();
             start_cycles = Profiler::read_cycles();
         }
         ~Section() {
-            profiler.add_measurement(name, Profiler::read_cycles() - start_cycles);
+            const uint64_t cycles = Profiler::read_cycles() - start_cycles;
+            if (profiler.perf_counters_enabled()) {
+                PerfCounters::Reading events = profiler.read_perf_counters();
+                for (int e = 0; e < PerfCounters::n_events; ++e) events[e] -= start_events[e];
+                profiler.perf_samples[name].push_back({events, cells, cycles});
+            }
+            profiler.add_measurement(name, cycles);
         }
     };
 
     protected:
+    struct PerfSample {
+        PerfCounters::Reading events;
+        uint64_t cells;
+        uint64_t tsc_cycles;
+    };
+    std::vector<std::unique_ptr<PerfCounters>> perf; // one per thread, see enable_perf_counters
+    std::map<std::string, std::vector<PerfSample>> perf_samples;
     std::map<std::string, std::vector<uint64_t>> measurements;
     std::map<std::string, std::vector<int32_t>> counters;
 };
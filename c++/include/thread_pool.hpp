@@ -0,0 +1,85 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace parallel {
+
+// Barrier that busy-waits for a short while before parking the thread on the
+// generation counter. Steps are short and back to back, so most waits end
+// while still spinning; idle workers between frames end up parked.
+class SpinBarrier {
+public:
+    explicit SpinBarrier(unsigned count, unsigned spin_count = 4096)
+        : count(count), spin_count(spin_count) {}
+
+    void arrive_and_wait();
+
+private:
+    const unsigned count;
+    const unsigned spin_count;
+    std::atomic<unsigned> waiting{0};
+    std::atomic<unsigned> generation{0};
+};
+
+// Persistent pool of workers. The calling thread takes part as worker 0, so a
+// pool of size 1 runs everything inline without any synchronization.
+class ThreadPool {
+public:
+    // n_threads == 0 picks std::thread::hardware_concurrency()
+    explicit ThreadPool(unsigned n_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return n_workers; }
+    // size() of a pool constructed with n_threads
+    static unsigned size_for(unsigned n_threads);
+
+    // Calls task(worker_index) on every worker and returns once all are done.
+    // While the pool is already running a task, called from inside it or from
+    // another thread, runs task for every worker index in turn on the caller.
+    template <typename Task>
+    void run(Task&& task) {
+        using TaskT = std::remove_reference_t<Task>;
+        dispatch([](void* ctx, unsigned worker) { (*static_cast<TaskT*>(ctx))(worker); },
+                 const_cast<void*>(static_cast<const void*>(&task)));
+    }
+
+    // Splits [begin, end) into size() contiguous bands and calls
+    // body(band_begin, band_end) for each of them, one band per worker.
+    template <typename Body>
+    void parallel_for(std::size_t begin, std::size_t end, Body&& body) {
+        run([&](unsigned worker) {
+            auto [b, e] = band(begin, end, worker, n_workers);
+            if (b < e) body(b, e);
+        });
+    }
+
+    static std::pair<std::size_t, std::size_t> band(std::size_t begin, std::size_t end, unsigned index, unsigned count) {
+        const std::size_t n = end - begin;
+        const std::size_t base = n / count, extra = n % count;
+        const std::size_t b = begin + index * base + std::min<std::size_t>(index, extra);
+        return {b, b + base + (index < extra ? 1 : 0)};
+    }
+
+private:
+    using Invoke = void (*)(void*, unsigned);
+    void dispatch(Invoke fn, void* ctx);
+    void worker_loop(unsigned index);
+
+    unsigned n_workers;
+    SpinBarrier start, done;
+    std::vector<std::thread> threads;
+    Invoke invoke = nullptr;
+    void* context = nullptr;
+    std::atomic<bool> running{false};
+    bool stopping = false;
+};
+
+} // namespace parallel
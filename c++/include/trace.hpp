@@ -0,0 +1,244 @@
+#pragma once
+#include <profiler.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Tracing mode of the profiler, cheap enough for per-step and per-band
+// scopes in the threaded solver. Section names are interned once per name at
+// static initialisation (trace::Scope<"band">), and every thread appends
+// begin/end events to its own ring buffer with no locks and no allocation;
+// when a ring is full the oldest events are overwritten. A thread takes a ring
+// at its first traced scope and gives it back when it exits; the ring keeps
+// its events until another thread takes it over. Events are paired
+// and merged across threads only on export, as a Chrome / Perfetto trace.
+// Export while the traced threads are idle, e.g. between frames.
+namespace trace {
+
+// A string literal as a template argument
+template <size_t N>
+struct Name {
+    char value[N];
+    constexpr Name(const char (&s)[N]) { std::copy_n(s, N, value); }
+};
+
+// Events kept per thread; 16 bytes each
+inline constexpr size_t ring_events = 1 << 16;
+
+struct Event {
+    uint64_t tsc;
+    uint32_t section; // end_bit set for the end of a scope
+    uint32_t arg;
+};
+inline constexpr uint32_t end_bit = 1u << 31;
+
+// One thread's ring. Only its owner writes; head counts every event so far.
+// name is written under the registry mutex.
+struct ThreadBuffer {
+    std::unique_ptr<Event[]> events{new Event[ring_events]};
+    std::atomic<uint64_t> head{0};
+    std::string name;
+};
+
+inline std::atomic<bool> tracing{false};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::string> sections;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads; // outlive their threads
+    std::vector<ThreadBuffer*> free;                    // of threads that exited
+
+    static Registry& get()
+    {
+        static Registry registry;
+        return registry;
+    }
+};
+
+inline uint32_t intern(const char* name)
+{
+    Registry& r = Registry::get();
+    std::lock_guard lock(r.mutex);
+    const auto it = std::find(r.sections.begin(), r.sections.end(), name);
+    if (it != r.sections.end()) return uint32_t(it - r.sections.begin());
+    r.sections.push_back(name);
+    return uint32_t(r.sections.size() - 1);
+}
+
+template <Name N>
+inline const uint32_t section_id = intern(N.value);
+
+// The calling thread's name and ring, if it has taken one; the ring goes
+// back to the free list when the thread exits.
+struct ThreadState {
+    std::string name;
+    ThreadBuffer* buffer = nullptr;
+
+    ~ThreadState()
+    {
+        if (!buffer) return;
+        Registry& r = Registry::get();
+        std::lock_guard lock(r.mutex);
+        r.free.push_back(buffer);
+    }
+};
+
+inline ThreadState& thread_state()
+{
+    thread_local ThreadState state;
+    return state;
+}
+
+// The calling thread's ring: a free one, whose events are dropped, or a new one
+inline ThreadBuffer& thread_buffer()
+{
+    ThreadState& state = thread_state();
+    if (state.buffer) return *state.buffer;
+    Registry& r = Registry::get();
+    std::lock_guard lock(r.mutex);
+    if (!r.free.empty()) {
+        state.buffer = r.free.back();
+        r.free.pop_back();
+        state.buffer->head.store(0, std::memory_order_relaxed);
+    } else {
+        r.threads.push_back(std::make_unique<ThreadBuffer>());
+        state.buffer = r.threads.back().get();
+    }
+    const size_t index = size_t(std::find_if(r.threads.begin(), r.threads.end(),
+                                             [&](const auto& t) { return t.get() == state.buffer; }) -
+                                r.threads.begin());
+    state.buffer->name = state.name.empty() ? "thread " + std::to_string(index) : state.name;
+    return *state.buffer;
+}
+
+inline void record(uint32_t section, uint32_t arg)
+{
+    ThreadBuffer& b = thread_buffer();
+    const uint64_t h = b.head.load(std::memory_order_relaxed);
+    b.events[h & (ring_events - 1)] = {Profiler::read_cycles(), section, arg};
+    b.head.store(h + 1, std::memory_order_release);
+}
+
+inline void enable(bool on = true) { tracing.store(on, std::memory_order_relaxed); }
+inline bool enabled() { return tracing.load(std::memory_order_relaxed); }
+
+// Shown as the calling thread's name in the trace. Takes no ring; one taken
+// later gets the name.
+inline void set_thread_name(std::string name)
+{
+    ThreadState& state = thread_state();
+    state.name = std::move(name);
+    if (!state.buffer) return;
+    Registry& r = Registry::get();
+    std::lock_guard lock(r.mutex);
+    state.buffer->name = state.name;
+}
+
+// Begin event on construction, end event on destruction, if tracing was on at
+// construction; arg (e.g. the first row of a band) goes with the begin event.
+template <Name N>
+struct Scope {
+    bool active;
+
+    explicit Scope(uint32_t arg = 0) : active(enabled())
+    {
+        if (active) record(section_id<N>, arg);
+    }
+    ~Scope()
+    {
+        if (active) record(section_id<N> | end_bit, 0);
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+
+// Drops all recorded events
+inline void clear()
+{
+    Registry& r = Registry::get();
+    std::lock_guard lock(r.mutex);
+    for (auto& t : r.threads) t->head.store(0, std::memory_order_relaxed);
+}
+
+// A begin/end pair on one thread
+struct Span {
+    uint64_t begin, end; // TSC
+    uint32_t section, arg;
+    size_t thread;
+};
+
+// The spans of all threads, by start time. Ends whose begin was overwritten
+// and scopes still open are left out.
+inline std::vector<Span> collect()
+{
+    Registry& r = Registry::get();
+    std::lock_guard lock(r.mutex);
+    std::vector<Span> spans;
+    for (size_t t = 0; t < r.threads.size(); ++t) {
+        const ThreadBuffer& b = *r.threads[t];
+        const uint64_t head = b.head.load(std::memory_order_acquire);
+        const uint64_t first = head > ring_events ? head - ring_events : 0;
+        std::vector<Event> open;
+        for (uint64_t i = first; i < head; ++i) {
+            const Event& e = b.events[i & (ring_events - 1)];
+            if (!(e.section & end_bit)) {
+                open.push_back(e);
+                continue;
+            }
+            // scopes nest, so an end closes the innermost open scope
+            if (open.empty() || open.back().section != (e.section & ~end_bit)) continue;
+            spans.push_back({open.back().tsc, e.tsc, open.back().section, open.back().arg, t});
+            open.pop_back();
+        }
+    }
+    std::stable_sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) { return a.begin < b.begin; });
+    return spans;
+}
+
+// Chrome trace event JSON, for chrome://tracing or ui.perfetto.dev: one
+// complete ("X") event per span in microseconds from the first span, one track
+// per thread.
+inline bool write_chrome_json(std::ostream& os)
+{
+    const std::vector<Span> spans = collect();
+    std::vector<std::string> sections, threads;
+    {
+        Registry& r = Registry::get();
+        std::lock_guard lock(r.mutex);
+        sections = r.sections;
+        for (const auto& t : r.threads) threads.push_back(t->name);
+    }
+    const double us_per_tick = 1e6 / Profiler::tsc_frequency();
+    const uint64_t t0 = spans.empty() ? 0 : spans.front().begin;
+    auto quoted = [](const std::string& s) {
+        std::string q = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') q += '\\';
+            q += c;
+        }
+        return q + "\"";
+    };
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    for (size_t t = 0; t < threads.size(); ++t)
+        os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":"
+           << quoted(threads[t]) << "}},\n";
+    const auto precision = os.precision(3);
+    const auto flags = os.setf(std::ios::fixed, std::ios::floatfield);
+    for (const Span& s : spans)
+        os << "{\"name\":" << quoted(sections[s.section]) << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << s.thread
+           << ",\"ts\":" << (s.begin - t0) * us_per_tick << ",\"dur\":" << (s.end - s.begin) * us_per_tick
+           << ",\"args\":{\"arg\":" << s.arg << "}},\n";
+    os.precision(precision);
+    os.flags(flags);
+    os << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"gray-scott\"}}\n]}\n";
+    return bool(os);
+}
+
+} // namespace trace
@@ -1,7 +1,20 @@
 #include <benchmark/benchmark.h>
 #include <matrix.hpp>
 #include <matrix_ops.hpp>
+#include <gray_scott.hpp>
+#include <kernels.hpp>
+#include <ensemble.hpp>
+#include <domain.hpp>
+#include <pipeline.hpp>
+#include <thread_pool.hpp>
+#include <trace.hpp>
+#include <algorithm>
 #include <cstring>
+#include <string>
+#include <unistd.h>
+#include <optional>
+#include <cmath>
+#include <vector>
 
 using namespace matrix;
 using namespace matrix::ops;
@@ -25,6 +38,8 @@ static void BM_conv3x3_f32(benchmark::State& state) {
     }
 }
 static void BM_conv3x3_f32_avx2(benchmark::State& state) {
+    if (!GrayScott::kernels::cpu_supports(GrayScott::kernels::Isa::avx2))
+        return state.SkipWithError("no AVX2 on this CPU");
     const size_t n = state.range(0);
     auto A = randu<float>(n,n);
     auto B1 = zeros<float>(A.get_shape());
@@ -37,7 +52,465 @@ static void BM_conv3x3_f32_avx2(benchmark::State& state) {
     }
 }
 
+static void BM_conv3x3_f32_avx512(benchmark::State& state) {
+    if (!GrayScott::kernels::cpu_supports(GrayScott::kernels::Isa::avx512))
+        return state.SkipWithError("no AVX-512 on this CPU");
+    const size_t n = state.range(0);
+    auto A = randu<float>(n,n);
+    auto B1 = zeros<float>(A.get_shape());
+    auto K = zeros<float>(3,3);
+    std::memcpy(K.get_data(), kernel_data, sizeof(kernel_data));
+
+    for (auto _ : state) {
+         conv3x3_f32_avx512(A, K, B1);
+    }
+}
+
+static void BM_gray_scott_step(benchmark::State& state, const char* backend_type) {
+    const unsigned n = state.range(0);
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, n, n, 10, 0, {}, 20};
+    auto backend = GrayScott::Backend::create(backend_type);
+    if (!backend) return state.SkipWithError("backend not supported on this CPU");
+    backend->initialize(params);
+
+    for (auto _ : state) {
+        backend->gray_scott_step(params.dt);
+    }
+    state.SetItemsProcessed(state.iterations() * n * n);
+}
+
+// Fields on 4 KB pages vs 2 MB huge pages, first touched by their workers.
+static void BM_gray_scott_pages(benchmark::State& state, matrix::Pages pages) {
+    const unsigned n = state.range(0);
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, n, n, 10, 0, {}, 20};
+    params.pages = pages;
+    auto backend = GrayScott::Backend::create("threaded");
+    backend->initialize(params);
+
+    for (auto _ : state) {
+        backend->gray_scott_step(params.dt);
+    }
+    state.SetItemsProcessed(state.iterations() * n * n);
+}
+
+// A display going back and forth between two resolutions: the backend is
+// initialized again for each, with or without a matrix::BufferPool in scope.
+static void BM_backend_resize(benchmark::State& state, bool pooled) {
+    const unsigned sizes[][2] = {{1080, 1920}, {2160, 3840}};
+    auto pool = matrix::BufferPool::create();
+    std::optional<matrix::BufferPool::Scope> scope;
+    if (pooled) scope.emplace(pool);
+    auto backend = GrayScott::Backend::create("threaded");
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto [rows, cols] = sizes[i++ % 2];
+        GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, rows, cols, 10, 0, {}, 20};
+        backend->initialize(params);
+    }
+    state.counters["pool_hits"] = pool->stats().hits;
+}
+
+// Halo update of the two fields of an n x n grid: the torus wrap, or the
+// edges of a single subdomain published to and read back from shared memory
+static void BM_halo_exchange(benchmark::State& state, bool shared) {
+    const uint32_t n = state.range(0);
+    const Layout layout{.halo = 1, .row_align = 64};
+    auto U = Matrix<float, 2>::ones({n, n}, layout), V = Matrix<float, 2>::zeros({n, n}, layout);
+    const std::string name = "gs-benchmark-" + std::to_string(::getpid());
+    auto domain = shared ? GrayScott::SharedDomain::create(name, n, n, 1, 1) : nullptr;
+    if (shared && !domain) return state.SkipWithError("no shared memory");
+    uint64_t step = 0;
+    for (auto _ : state) {
+        if (domain) {
+            domain->publish(0, step, U, V);
+            domain->receive(0, step++, U, V);
+        } else {
+            U.refresh_halo();
+            V.refresh_halo();
+        }
+        benchmark::DoNotOptimize(U.get_data());
+    }
+    if (domain) GrayScott::SharedDomain::unlink(name);
+    state.SetItemsProcessed(state.iterations() * 2 * 4 * n);
+}
+
+// A scalar 3x3 box filter written with each way of indexing a View; all
+// three should compile to the same loop.
+enum class Indexing { brackets, call, rows };
+
+static void BM_view_indexing(benchmark::State& state, Indexing indexing) {
+    const size_t n = state.range(0);
+    auto A = randu<float>(n, n), B = zeros<float>(n, n);
+    const auto a = A.view();
+    const auto b = B.view();
+    for (auto _ : state) {
+        for (size_t i = 1; i + 1 < n; ++i) {
+            const float* r0 = a.row(i - 1);
+            const float* r1 = a.row(i);
+            const float* r2 = a.row(i + 1);
+            float* out = b.row(i);
+            for (size_t j = 1; j + 1 < n; ++j) {
+                float sum = 0.0f;
+                if (indexing == Indexing::brackets) {
+                    for (size_t ki = 0; ki < 3; ++ki)
+                        for (size_t kj = 0; kj < 3; ++kj) sum += a[i + ki - 1][j + kj - 1];
+                    b[i][j] = sum;
+                } else if (indexing == Indexing::call) {
+                    for (size_t ki = 0; ki < 3; ++ki)
+                        for (size_t kj = 0; kj < 3; ++kj) sum += a(i + ki - 1, j + kj - 1);
+                    b(i, j) = sum;
+                } else {
+                    for (size_t kj = 0; kj < 3; ++kj) sum += r0[j + kj - 1] + r1[j + kj - 1] + r2[j + kj - 1];
+                    out[j] = sum;
+                }
+            }
+        }
+        benchmark::DoNotOptimize(B.get_data());
+    }
+    state.SetItemsProcessed(state.iterations() * n * n);
+}
+
+// The Gray-Scott update of U as one matrix expression, with the Laplacian
+// given; threaded splits the rows over a pool.
+static void BM_matrix_expr(benchmark::State& state, bool threaded) {
+    const size_t n = state.range(0);
+    auto U = randu<float>(n, n), V = randu<float>(n, n), L = randn<float>(n, n), out = U.similar();
+    const float Du = 0.16f, F = 0.0367f, dt = 1.0f;
+    std::optional<parallel::ThreadPool> pool;
+    ParallelFor parallel_for;
+    if (threaded) {
+        pool.emplace();
+        parallel_for = [&](size_t rows, const std::function<void(size_t, size_t)>& body) {
+            pool->parallel_for(0, rows, body);
+        };
+    }
+    for (auto _ : state) {
+        assign(out, U + (Du * L - U * V * V + F * (1.0f - U)) * dt, parallel_for);
+        benchmark::DoNotOptimize(out.get_data());
+    }
+    state.SetItemsProcessed(state.iterations() * n * n);
+    state.SetBytesProcessed(state.iterations() * n * n * 4 * sizeof(float));
+}
+
+// randu/randn of range(0) MB in GB/s; threaded spreads the rng_block
+// blocks over a pool.
+static void BM_rand_fill(benchmark::State& state, bool normal, bool threaded) {
+    const size_t n = (size_t(state.range(0)) << 20) / sizeof(float);
+    std::vector<float> data(n);
+    std::optional<parallel::ThreadPool> pool;
+    ParallelFor parallel_for;
+    if (threaded) {
+        pool.emplace();
+        parallel_for = [&](size_t blocks, const std::function<void(size_t, size_t)>& body) {
+            pool->parallel_for(0, blocks, body);
+        };
+    }
+    uint64_t seed = 0;
+    for (auto _ : state) {
+        if (normal)
+            randn(data.data(), n, ++seed, parallel_for);
+        else
+            randu(data.data(), n, ++seed, parallel_for);
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetBytesProcessed(state.iterations() * n * sizeof(float));
+}
+
+// The generator kernels of one ISA into an L1-resident buffer
+static void BM_rng_kernel(benchmark::State& state, const char* kernels_name, bool normal) {
+    const GrayScott::kernels::Kernels* k = GrayScott::kernels::find(kernels_name);
+    if (!k) return state.SkipWithError("kernels not supported on this CPU");
+    std::vector<float> data(4096);
+    auto rng = GrayScott::kernels::rng_substreams(0, 1)[0];
+    const auto generate = normal ? k->normal : k->uniform;
+    for (auto _ : state) {
+        generate(rng, data.data(), data.size());
+        benchmark::DoNotOptimize(data.data());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size() * sizeof(float));
+}
+
+// Startup at 8K: initialize with a pool in scope, and threaded backends keep
+// their workers across initializes, so after the first iteration only
+// generating the initial state is timed.
+static void BM_initialize(benchmark::State& state, const char* backend_type, GrayScott::Pattern pattern) {
+    matrix::BufferPool::Scope scope(matrix::BufferPool::create());
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, 4320, 7680, 10, 0, {}, 20};
+    params.pattern = pattern;
+    auto backend = GrayScott::Backend::create(backend_type);
+    for (auto _ : state) {
+        backend->initialize(params);
+    }
+    state.SetItemsProcessed(state.iterations() * params.Nx * params.Ny);
+}
+
+// Tracing costs two TSC reads and ring writes per step and per band.
+static void BM_gray_scott_step_traced(benchmark::State& state, const char* backend_type) {
+    const unsigned n = state.range(0);
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, n, n, 10, 0, {}, 20};
+    auto backend = GrayScott::Backend::create(backend_type);
+    backend->initialize(params);
+
+    trace::enable();
+    for (auto _ : state) {
+        backend->gray_scott_step(params.dt);
+    }
+    trace::enable(false);
+    trace::clear();
+    state.SetItemsProcessed(state.iterations() * n * n);
+}
+
+static void BM_gray_scott_steps_blocked(benchmark::State& state, const char* backend_type) {
+    const unsigned n = state.range(0);
+    const unsigned T = state.range(1);
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, n, n, 10, 0, {}, 20, {}, T};
+    auto backend = GrayScott::Backend::create(backend_type);
+    if (!backend) return state.SkipWithError("backend not supported on this CPU");
+    backend->initialize(params);
+
+    for (auto _ : state) {
+        backend->gray_scott_steps(params.dt, T);
+    }
+    state.SetItemsProcessed(state.iterations() * n * n * T);
+}
+
+// Step throughput with U/V kept in 16-bit storage, plus the drift from the
+// fp32 result after error_steps steps on an error_n x error_n grid.
+static void BM_gray_scott_storage(benchmark::State& state, GrayScott::Storage storage) {
+    const unsigned n = state.range(0);
+    constexpr unsigned error_n = 256, error_steps = 1000;
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, n, n, 10, 0, {}, 20};
+    params.storage = storage;
+    auto backend = GrayScott::Backend::create("avx256");
+    backend->initialize(params);
+
+    for (auto _ : state) {
+        backend->gray_scott_step(params.dt);
+    }
+    state.SetItemsProcessed(state.iterations() * n * n);
+
+    auto run = [&](GrayScott::Storage s, std::vector<float>& U, std::vector<float>& V) {
+        GrayScott::Params p = params;
+        p.Nx = p.Ny = error_n;
+        p.storage = s;
+        auto b = GrayScott::Backend::create("avx256");
+        b->initialize(p);
+        b->gray_scott_steps(p.dt, error_steps);
+        U.resize(error_n * error_n);
+        V.resize(error_n * error_n);
+        b->read_state(U.data(), V.data());
+    };
+    std::vector<float> U_ref, V_ref, U, V;
+    run(GrayScott::Storage::f32, U_ref, V_ref);
+    run(storage, U, V);
+    auto max_err = [](const std::vector<float>& a, const std::vector<float>& b) {
+        double e = 0;
+        for (size_t i = 0; i < a.size(); ++i) e = std::max(e, std::fabs(double(a[i]) - b[i]));
+        return e;
+    };
+    state.counters["U_max_err_vs_f32"] = max_err(U, U_ref);
+    state.counters["V_max_err_vs_f32"] = max_err(V, V_ref);
+}
+
+// Steps a 0.03/0.062 grid, where the spots fade and most tiles settle, after
+// warm_steps; with a threshold the activity mask skips the quiet tiles.
+static void BM_activity_mask(benchmark::State& state, std::optional<float> threshold) {
+    const unsigned n = state.range(0);
+    constexpr unsigned warm_steps = 4000, error_steps = 4000;
+    GrayScott::Params params{0.16f, 0.08f, 0.03f, 0.062f, 1.0f, 0.02f, n, n, 10, 0, {}, 20};
+    params.activity_threshold = threshold;
+    auto run = [&](const GrayScott::Params& p, unsigned steps) {
+        auto b = GrayScott::Backend::create("auto");
+        b->initialize(p);
+        b->gray_scott_steps(p.dt, steps);
+        return b;
+    };
+    auto backend = run(params, warm_steps);
+    const GrayScott::ActivityStats warm = backend->activity_stats();
+
+    for (auto _ : state) {
+        backend->gray_scott_step(params.dt);
+    }
+    state.SetItemsProcessed(state.iterations() * n * n);
+
+    const GrayScott::ActivityStats stats = backend->activity_stats();
+    const double skipped = stats.tiles_skipped - warm.tiles_skipped;
+    const double stepped = stats.tiles_stepped - warm.tiles_stepped;
+    state.counters["tiles_skipped"] = skipped + stepped > 0 ? skipped / (skipped + stepped) : 0.0;
+
+    GrayScott::Params full = params;
+    full.activity_threshold.reset();
+    std::vector<float> U_ref(size_t(n) * n), V_ref(U_ref.size()), U(U_ref.size()), V(U_ref.size());
+    run(full, warm_steps + error_steps)->read_state(U_ref.data(), V_ref.data());
+    run(params, warm_steps + error_steps)->read_state(U.data(), V.data());
+    double err = 0;
+    for (size_t i = 0; i < U.size(); ++i)
+        err = std::max({err, std::fabs(double(U[i]) - U_ref[i]), std::fabs(double(V[i]) - V_ref[i])});
+    state.counters["max_err_vs_full"] = err;
+}
+
+static void BM_copy_to_output(benchmark::State& state, const char* backend_type, GrayScott::OutputFormat format) {
+    const unsigned n = state.range(0);
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, n, n, 10, 0, {}, 20};
+    auto backend = GrayScott::Backend::create(backend_type);
+    if (!backend) return state.SkipWithError("backend not supported on this CPU");
+    backend->initialize(params);
+    std::vector<uint32_t> frame(n * n);
+
+    for (auto _ : state) {
+        backend->copy_to_output(frame.data(), format, 0);
+        benchmark::DoNotOptimize(frame.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n * n);
+}
+
+// A step and a rendered frame, either fused into one pass over the grid or
+// as gray_scott_step followed by copy_to_output.
+static void BM_gray_scott_step_to_output(benchmark::State& state, const char* backend_type, bool fused) {
+    const unsigned n = state.range(0);
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, n, n, 10, 0, {}, 20};
+    auto backend = GrayScott::Backend::create(backend_type);
+    if (!backend) return state.SkipWithError("backend not supported on this CPU");
+    backend->initialize(params);
+    std::vector<uint32_t> frame(n * n);
+
+    for (auto _ : state) {
+        if (fused) {
+            backend->gray_scott_step_to_output(params.dt, frame.data(), GrayScott::OutputFormat::RGBA8, 0);
+        } else {
+            backend->gray_scott_step(params.dt);
+            backend->copy_to_output(frame.data(), GrayScott::OutputFormat::RGBA8, 0);
+        }
+        benchmark::DoNotOptimize(frame.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n * n);
+}
+
+// Unpaced solver with the renderer on its own thread; frames the consumer
+// cannot keep up with are dropped.
+static void BM_pipeline(benchmark::State& state, const char* backend_type) {
+    const unsigned n = state.range(0);
+    const unsigned substeps = state.range(1);
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, n, n, 10, 0, {}, 0};
+    auto backend = GrayScott::Backend::create(backend_type);
+    if (!backend) return state.SkipWithError("backend not supported on this CPU");
+    backend->initialize(params);
+    GrayScott::Pipeline::Options options;
+    options.substeps = substeps;
+    GrayScott::Pipeline pipeline(*backend, params, GrayScott::Colormap{}, options,
+                                 [](const uint8_t* pixels, size_t, uint64_t) { benchmark::DoNotOptimize(pixels); });
+
+    GrayScott::Pipeline::Stats total;
+    for (auto _ : state) {
+        auto s = pipeline.run(100);
+        total.steps += s.steps;
+        total.frames_rendered += s.frames_rendered;
+        total.frames_dropped += s.frames_dropped;
+    }
+    state.SetItemsProcessed(total.steps * n * n);
+    state.counters["frames_rendered"] = benchmark::Counter(total.frames_rendered, benchmark::Counter::kAvgIterations);
+    state.counters["frames_dropped"] = benchmark::Counter(total.frames_dropped, benchmark::Counter::kAvgIterations);
+}
+
+// A parameter sweep of range(1) members on range(0)^2 thumbnails, stepped as
+// one ensemble or as one backend per member. Items are member cells.
+static std::vector<GrayScott::EnsembleMember> sweep_members(size_t n)
+{
+    std::vector<GrayScott::EnsembleMember> members(n);
+    for (size_t m = 0; m < n; ++m) members[m] = {0.01f + 0.06f * m / n, 0.045f + 0.025f * (m % 8) / 8};
+    return members;
+}
+
+static void BM_ensemble_step(benchmark::State& state, const char* type) {
+    const unsigned n = state.range(0);
+    const size_t n_members = state.range(1);
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.02f, n, n, 10, 0, {}, 20};
+    auto ensemble = GrayScott::Ensemble::create(type);
+    if (!ensemble) return state.SkipWithError("ensemble not supported on this CPU");
+    ensemble->initialize(params, sweep_members(n_members));
+
+    for (auto _ : state) {
+        ensemble->gray_scott_step(params.dt);
+    }
+    state.SetItemsProcessed(state.iterations() * n * n * n_members);
+}
+
+static void BM_ensemble_separate(benchmark::State& state, const char* backend_type) {
+    const unsigned n = state.range(0);
+    const size_t n_members = state.range(1);
+    std::vector<std::unique_ptr<GrayScott::Backend>> backends;
+    for (const auto& m : sweep_members(n_members)) {
+        GrayScott::Params params{0.16f, 0.08f, m.F, m.k, 1.0f, 0.02f, n, n, 10, 0, {}, 20};
+        auto backend = GrayScott::Backend::create(backend_type);
+        if (!backend) return state.SkipWithError("backend not supported on this CPU");
+        backend->initialize(params);
+        backends.push_back(std::move(backend));
+    }
+
+    for (auto _ : state) {
+        for (auto& backend : backends) backend->gray_scott_step(1.0f);
+    }
+    state.SetItemsProcessed(state.iterations() * n * n * n_members);
+}
+
 BENCHMARK(BM_conv3x3_f32)->Arg(128)->Arg(256)->Arg(512);
 BENCHMARK(BM_conv3x3_f32_avx2)->Arg(128)->Arg(256)->Arg(512);
+BENCHMARK(BM_conv3x3_f32_avx512)->Arg(128)->Arg(256)->Arg(512);
+BENCHMARK_CAPTURE(BM_gray_scott_step, naive, "naive")->Arg(512)->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_step, avx256, "avx256")->Arg(512)->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_step, scalar, "scalar")->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_step, sse42, "sse42")->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_step, avx512, "avx512")->Arg(512)->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_step, auto, "auto")->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_step, threaded, "threaded")->Arg(512)->Arg(2048)->UseRealTime();
+BENCHMARK_CAPTURE(BM_gray_scott_step_traced, threaded, "threaded")->Arg(512)->Arg(2048)->UseRealTime();
+BENCHMARK_CAPTURE(BM_backend_resize, malloc, false);
+BENCHMARK_CAPTURE(BM_backend_resize, pooled, true);
+BENCHMARK_CAPTURE(BM_halo_exchange, wrap, false)->Arg(4096);
+BENCHMARK_CAPTURE(BM_halo_exchange, shared, true)->Arg(4096);
+BENCHMARK_CAPTURE(BM_view_indexing, brackets, Indexing::brackets)->Arg(1024);
+BENCHMARK_CAPTURE(BM_view_indexing, call, Indexing::call)->Arg(1024);
+BENCHMARK_CAPTURE(BM_view_indexing, rows, Indexing::rows)->Arg(1024);
+BENCHMARK_CAPTURE(BM_matrix_expr, serial, false)->Arg(2048)->UseRealTime();
+BENCHMARK_CAPTURE(BM_matrix_expr, threaded, true)->Arg(2048)->UseRealTime();
+BENCHMARK_CAPTURE(BM_rand_fill, randu, false, false)->Arg(64)->UseRealTime();
+BENCHMARK_CAPTURE(BM_rand_fill, randu_threaded, false, true)->Arg(64)->UseRealTime();
+BENCHMARK_CAPTURE(BM_rand_fill, randn, true, false)->Arg(64)->UseRealTime();
+BENCHMARK_CAPTURE(BM_rand_fill, randn_threaded, true, true)->Arg(64)->UseRealTime();
+BENCHMARK_CAPTURE(BM_rng_kernel, uniform_scalar, "scalar", false);
+BENCHMARK_CAPTURE(BM_rng_kernel, uniform_avx2, "avx2", false);
+BENCHMARK_CAPTURE(BM_rng_kernel, uniform_avx512, "avx512", false);
+BENCHMARK_CAPTURE(BM_rng_kernel, normal_scalar, "scalar", true);
+BENCHMARK_CAPTURE(BM_rng_kernel, normal_avx2, "avx2", true);
+BENCHMARK_CAPTURE(BM_rng_kernel, normal_avx512, "avx512", true);
+BENCHMARK_CAPTURE(BM_initialize, naive, "naive", GrayScott::Pattern::noise)->UseRealTime();
+BENCHMARK_CAPTURE(BM_initialize, threaded, "threaded", GrayScott::Pattern::noise)->UseRealTime();
+BENCHMARK_CAPTURE(BM_initialize, threaded_spots, "threaded", GrayScott::Pattern::spots)->UseRealTime();
+BENCHMARK_CAPTURE(BM_gray_scott_pages, normal, matrix::Pages::normal)->Arg(4096)->UseRealTime();
+BENCHMARK_CAPTURE(BM_gray_scott_pages, huge, matrix::Pages::huge)->Arg(4096)->UseRealTime();
+BENCHMARK_CAPTURE(BM_gray_scott_steps_blocked, avx256, "avx256")->Args({2048, 1})->Args({2048, 4})->Args({2048, 8});
+BENCHMARK_CAPTURE(BM_gray_scott_steps_blocked, avx512, "avx512")->Args({2048, 1})->Args({2048, 8});
+BENCHMARK_CAPTURE(BM_gray_scott_storage, f32, GrayScott::Storage::f32)->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_storage, f16, GrayScott::Storage::f16)->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_storage, bf16, GrayScott::Storage::bf16)->Arg(2048);
+BENCHMARK_CAPTURE(BM_activity_mask, off, std::nullopt)->Arg(1024);
+BENCHMARK_CAPTURE(BM_activity_mask, masked, 1e-5f)->Arg(1024);
+BENCHMARK_CAPTURE(BM_gray_scott_steps_blocked, threaded, "threaded")->Args({2048, 1})->Args({2048, 8})->UseRealTime();
+
+BENCHMARK_CAPTURE(BM_copy_to_output, naive_rgba, "naive", GrayScott::OutputFormat::RGBA8)->Arg(2048);
+BENCHMARK_CAPTURE(BM_copy_to_output, avx256_rgba, "avx256", GrayScott::OutputFormat::RGBA8)->Arg(2048);
+BENCHMARK_CAPTURE(BM_copy_to_output, avx256_bgra, "avx256", GrayScott::OutputFormat::BGRA8)->Arg(2048);
+BENCHMARK_CAPTURE(BM_copy_to_output, avx256_gray, "avx256", GrayScott::OutputFormat::Gray8)->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_step_to_output, avx256_separate, "avx256", false)->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_step_to_output, avx256_fused, "avx256", true)->Arg(2048);
+BENCHMARK_CAPTURE(BM_copy_to_output, avx512_rgba, "avx512", GrayScott::OutputFormat::RGBA8)->Arg(2048);
+BENCHMARK_CAPTURE(BM_copy_to_output, avx512_gray, "avx512", GrayScott::OutputFormat::Gray8)->Arg(2048);
+BENCHMARK_CAPTURE(BM_gray_scott_step_to_output, avx512_fused, "avx512", true)->Arg(2048);
+BENCHMARK_CAPTURE(BM_pipeline, threaded, "threaded")->Args({2048, 1})->Args({2048, 4})->UseRealTime();
+BENCHMARK_CAPTURE(BM_ensemble_separate, avx512, "avx512")->Args({128, 64});
+BENCHMARK_CAPTURE(BM_ensemble_step, scalar, "scalar")->Args({128, 64});
+BENCHMARK_CAPTURE(BM_ensemble_step, avx2, "avx2")->Args({128, 64});
+BENCHMARK_CAPTURE(BM_ensemble_step, avx512, "avx512")->Args({128, 64});
+BENCHMARK_CAPTURE(BM_ensemble_step, threaded, "threaded")->Args({128, 64})->Args({128, 256})->UseRealTime();
 
 BENCHMARK_MAIN();
@@ -0,0 +1,197 @@
+#include <checkpoint.hpp>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define GS_HAVE_MMAP 1
+#endif
+
+namespace {
+int64_t from_optional(const std::optional<unsigned>& v) { return v ? int64_t(*v) : -1; }
+std::optional<unsigned> to_optional(int64_t v) { return v < 0 ? std::nullopt : std::optional<unsigned>(unsigned(v)); }
+size_t round_up(size_t n, size_t multiple) { return (n + multiple - 1) / multiple * multiple; }
+}
+
+namespace GrayScott {
+
+CheckpointHeader CheckpointHeader::make(const Params& params, uint64_t step, size_t element_bytes,
+                                        const matrix::Layout& layout, size_t pitch, size_t origin, size_t storage_bytes)
+{
+    CheckpointHeader h{};
+    std::memcpy(h.magic, magic_value, sizeof(magic));
+    h.version = current_version;
+    h.header_bytes = page;
+    h.Du = params.Du;
+    h.Dv = params.Dv;
+    h.F = params.F;
+    h.k = params.k;
+    h.dt = params.dt;
+    h.initial_noise = params.initial_noise;
+    h.Nx = params.Nx;
+    h.Ny = params.Ny;
+    h.Ns = params.Ns;
+    h.fps = params.fps;
+    h.seed = from_optional(params.seed);
+    h.Nsteps = from_optional(params.Nsteps);
+    h.threads = from_optional(params.threads);
+    h.time_block = from_optional(params.time_block);
+    h.storage = uint32_t(params.storage);
+    h.step = step;
+    h.element_bytes = element_bytes;
+    h.halo = layout.halo;
+    h.row_align = layout.row_align;
+    h.pitch = pitch;
+    h.origin = origin;
+    h.plane_bytes = round_up(storage_bytes, page);
+    h.plane_offset[0] = page;
+    h.plane_offset[1] = page + h.plane_bytes;
+    h.activity_threshold = params.activity_threshold.value_or(0.0f);
+    h.activity_skip = params.activity_skip;
+    h.pattern = uint32_t(params.pattern);
+    h.pages = uint32_t(params.pages);
+    return h;
+}
+
+Params CheckpointHeader::params() const
+{
+    Params p{Du, Dv, F, k, dt, initial_noise, Nx, Ny, Ns, to_optional(seed), to_optional(Nsteps), fps};
+    p.threads = to_optional(threads);
+    p.time_block = to_optional(time_block);
+    p.storage = Storage(storage);
+    if (activity_threshold > 0.0f) p.activity_threshold = activity_threshold;
+    if (activity_skip > 0) p.activity_skip = activity_skip;
+    p.pattern = Pattern(pattern);
+    p.pages = matrix::Pages(pages);
+    return p;
+}
+
+namespace {
+// The pitch, origin and extent of a plane as a Matrix<T, 2> of the header's
+// shape and layout lays it out; the mapping serves as that matrix as is.
+template <typename T>
+bool plane_fits(const CheckpointHeader& h)
+{
+    using M = matrix::Matrix<T, 2>;
+    const matrix::Layout layout = h.layout();
+    const size_t pitch = M::row_pitch(h.Ny, layout);
+    const size_t rows = size_t(h.Nx) + 2 * size_t(h.halo);
+    if (h.pitch != pitch || h.origin != M::row_lead(layout) + h.halo * pitch) return false;
+    // rows * pitch elements and the vector a kernel may read past them
+    return rows <= (h.plane_bytes - h.row_align) / sizeof(T) / pitch;
+}
+} // namespace
+
+bool CheckpointHeader::valid() const
+{
+    if (std::memcmp(magic, magic_value, sizeof(magic)) != 0 || version != current_version || header_bytes != page ||
+        storage > uint32_t(Storage::bf16) || pattern > uint32_t(Pattern::spots) ||
+        pages > uint32_t(matrix::Pages::hugetlb))
+        return false;
+    // planes on their own pages, in order, not overlapping the header or each other
+    if (plane_offset[0] % page != 0 || plane_offset[1] % page != 0 || plane_offset[0] < page ||
+        plane_offset[1] < plane_offset[0] || plane_offset[1] - plane_offset[0] < plane_bytes)
+        return false;
+    // a layout Matrix accepts, with planes large enough for the shape
+    const bool aligned = row_align == 0 || (std::has_single_bit(row_align) && row_align >= 64);
+    if (Nx == 0 || Ny == 0 || halo > Nx || halo > Ny || !aligned || plane_bytes <= row_align) return false;
+    if (storage == uint32_t(Storage::f32)) return element_bytes == sizeof(float) && plane_fits<float>(*this);
+    return element_bytes == sizeof(uint16_t) && plane_fits<uint16_t>(*this);
+}
+
+std::shared_ptr<MappedCheckpoint> MappedCheckpoint::map(const std::string& path)
+{
+    std::shared_ptr<MappedCheckpoint> ckpt(new MappedCheckpoint());
+#if defined(GS_HAVE_MMAP)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < CheckpointHeader::page) {
+        ::close(fd);
+        return nullptr;
+    }
+    ckpt->length = size_t(st.st_size);
+    // private: the backend steps in place, written pages are copied by the kernel
+    void* p = ::mmap(nullptr, ckpt->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return nullptr;
+    ckpt->base = p;
+    ckpt->mapped = true;
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    if (!in) return nullptr;
+    ckpt->length = size_t(in.tellg());
+    if (ckpt->length < CheckpointHeader::page) return nullptr;
+    ckpt->base = ::operator new(ckpt->length, std::align_val_t(CheckpointHeader::page));
+    in.seekg(0);
+    if (!in.read(static_cast<char*>(ckpt->base), ckpt->length)) return nullptr;
+#endif
+    const auto& h = ckpt->header();
+    if (!h.valid() || h.plane_bytes > ckpt->length || h.plane_offset[1] > ckpt->length - h.plane_bytes)
+        return nullptr;
+    return ckpt;
+}
+
+MappedCheckpoint::~MappedCheckpoint()
+{
+    if (!base) return;
+#if defined(GS_HAVE_MMAP)
+    if (mapped) {
+        ::munmap(base, length);
+        return;
+    }
+#endif
+    ::operator delete(base, std::align_val_t(CheckpointHeader::page));
+}
+
+std::future<bool> write_checkpoint(const std::string& path, std::shared_ptr<std::byte[]> image, size_t bytes)
+{
+    return std::async(std::launch::async, [path, image = std::move(image), bytes] {
+        const std::string tmp = path + ".tmp";
+#if defined(GS_HAVE_MMAP)
+        // on disk before the rename, so that after a crash path holds the
+        // old checkpoint or the whole new one, never an empty file
+        const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        const char* p = reinterpret_cast<const char*>(image.get());
+        for (size_t left = bytes; left > 0;) {
+            const ssize_t n = ::write(fd, p, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                ::close(fd);
+                return false;
+            }
+            p += n;
+            left -= size_t(n);
+        }
+        const bool synced = ::fsync(fd) == 0;
+        if (::close(fd) != 0 || !synced) return false;
+#else
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(image.get()), bytes);
+            out.close();
+            if (!out) return false;
+        }
+#endif
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) return false;
+#if defined(GS_HAVE_MMAP)
+        // and the rename itself, through the directory
+        const auto dir = std::filesystem::path(path).parent_path();
+        const int dir_fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir_fd >= 0) {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+#endif
+        return true;
+    });
+}
+
+} // namespace GrayScott
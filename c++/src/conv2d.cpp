@@ -1,42 +1,65 @@
 #include <matrix.hpp>
 #include <immintrin.h>
 
+// Plik kompilowany dla bazowego ISA; tylko funkcje _avx2 / _avx512 używają
+// szerszych instrukcji i wolno je wołać tylko na procesorach, które je mają
+#if defined(_MSC_VER)
+#define GS_TARGET_AVX2
+#define GS_TARGET_AVX512
+#else
+#define GS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define GS_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
 using matrix::Matrix;
 namespace matrix::ops {
+// Without a halo the outer ring of the output is not written. With a halo of
+// at least one cell the ghost cells supply the neighbours and every output
+// cell is computed (call refresh_halo() first for periodic boundaries).
+static int border_skip(const Matrix<float,2>& input)
+{
+    return input.get_layout().halo >= 1 ? 0 : 1;
+}
+
 void conv3x3_f32(const Matrix<float,2>& input, const Matrix<float,2>& kernel, Matrix<float,2>& output)
 {
-    const auto n_rows = input.get_shape()[0];
-    const auto n_cols = input.get_shape()[1];
+    const int n_rows = input.get_shape()[0];
+    const int n_cols = input.get_shape()[1];
+    const int skip = border_skip(input);
+    const std::ptrdiff_t src_stride = input.get_strides()[0];
 
-    auto inp = input.view();
-    auto outp = output.view();
-    auto kern = kernel.view();
+    const auto kern = kernel.view();
 
-    for (unsigned i = 1; i < n_rows - 1; ++i) {
-        for (unsigned j = 1; j < n_cols - 1; ++j) {
+    for (int i = skip; i < n_rows - skip; ++i) {
+        float* out = output.row(i);
+        for (int j = skip; j < n_cols - skip; ++j) {
             float sum = 0.0f;
             for (int ki = -1; ki <= 1; ++ki) {
+                const float* row = input.get_data() + (i + ki) * src_stride;
                 for (int kj = -1; kj <= 1; ++kj) {
-                    sum += inp[i + ki][j + kj] * kern[ki + 1][kj + 1];
+                    sum += row[j + kj] * kern(ki + 1, kj + 1);
                 }
             }
-            outp[i][j] = sum;
+            out[j] = sum;
         }
     }
 }
 
-void conv3x3_f32_avx2(const Matrix<float,2>& input, const Matrix<float,2>& kernel, Matrix<float,2>& output) 
+GS_TARGET_AVX2
+void conv3x3_f32_avx2(const Matrix<float,2>& input, const Matrix<float,2>& kernel, Matrix<float,2>& output)
 {
-    auto inp = input.view();
-    auto outp = output.view();
-
     const float* __restrict src = input.get_data();
     const float* __restrict kern = kernel.get_data();
     float* __restrict dst = output.get_data();
     int width = input.get_shape()[1];
     int height = input.get_shape()[0];
-    int src_stride = input.get_shape()[1];
-    int dst_stride = output.get_shape()[1];
+    const std::ptrdiff_t src_stride = input.get_strides()[0];
+    const std::ptrdiff_t dst_stride = output.get_strides()[0];
+    const int skip = border_skip(input);
+    // Wiersze z wyrównaniem i paddingiem: ostatni wektor może wyjść poza
+    // koniec wiersza, więc nie ma ogona skalarowego
+    const bool padded = skip == 0 &&
+        input.get_layout().row_align >= 32 && output.get_layout().row_align >= 32;
 
     // Broadcast współczynników
     const __m256 k00 = _mm256_set1_ps(kern[0]);
@@ -49,20 +72,20 @@ void conv3x3_f32_avx2(const Matrix<float,2>& input, const Matrix<float,2>& kerne
     const __m256 k21 = _mm256_set1_ps(kern[7]);
     const __m256 k22 = _mm256_set1_ps(kern[8]);
 
-    // Przetwarzamy wiersze [1 .. height-2]
-    for (int y = 1; y <= height - 2; ++y) {
+    // Przetwarzamy wiersze [skip .. height-1-skip]
+    for (int y = skip; y < height - skip; ++y) {
         const float* r0 = src + (y - 1) * src_stride;
         const float* r1 = src + (y + 0) * src_stride;
         const float* r2 = src + (y + 1) * src_stride;
 
         float* drow = dst + y * dst_stride;
 
-        // Kolumny [1 .. width-2]
-        int x = 1;
+        // Kolumny [skip .. width-1-skip]
+        int x = skip;
 
         // Wektor: możemy załadować trójki: (x-1), x, (x+1)
-        // tak długo, jak (x+1)+7 <= width-1  => x <= width-9
-        const int xVecEnd = width - 9;
+        // tak długo, jak x+7 <= width-1-skip (z paddingiem: aż do końca wiersza)
+        const int xVecEnd = padded ? width - 1 : width - skip - 8;
 
         for (; x <= xVecEnd; x += 8) {
             // r0
@@ -92,8 +115,8 @@ void conv3x3_f32_avx2(const Matrix<float,2>& input, const Matrix<float,2>& kerne
             _mm256_storeu_ps(drow + x, acc);
         }
 
-        // Ogon skalarowy dla x = (xVecEnd+8) .. (width-2)
-        for (; x <= width - 2; ++x) {
+        // Ogon skalarowy dla x .. (width-1-skip)
+        for (; x < width - skip; ++x) {
             float sum =
                 r0[x - 1] * kern[0] + r0[x] * kern[1] + r0[x + 1] * kern[2] +
                 r1[x - 1] * kern[3] + r1[x] * kern[4] + r1[x + 1] * kern[5] +
@@ -104,4 +127,80 @@ void conv3x3_f32_avx2(const Matrix<float,2>& input, const Matrix<float,2>& kerne
     }
 }
 
-} //namespace matrix::ops
\ No newline at end of file
+// Pierwsze n kolumn wektora, n obcięte do [0, 16]
+GS_TARGET_AVX512
+static inline __mmask16 lanes16(int n)
+{
+    return n >= 16 ? __mmask16(0xFFFF) : n <= 0 ? __mmask16(0) : __mmask16((1u << n) - 1);
+}
+
+// [prev15, cur0 .. cur14] i [cur1 .. cur15, next0]
+GS_TARGET_AVX512
+static inline __m512 left(__m512 prev, __m512 cur)
+{
+    return _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(cur), _mm512_castps_si512(prev), 15));
+}
+
+GS_TARGET_AVX512
+static inline __m512 right(__m512 cur, __m512 next)
+{
+    return _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(next), _mm512_castps_si512(cur), 1));
+}
+
+// Jak wersja AVX2, ale bez ogona skalarowego: ostatni wektor wiersza jest
+// ładowany i zapisywany z maską. Sąsiedzi x-1 i x+1 powstają z wektorów
+// obok (valignd), więc każdy wiersz wejścia jest czytany raz.
+GS_TARGET_AVX512
+void conv3x3_f32_avx512(const Matrix<float,2>& input, const Matrix<float,2>& kernel, Matrix<float,2>& output)
+{
+    const float* __restrict src = input.get_data();
+    const float* __restrict kern = kernel.get_data();
+    float* __restrict dst = output.get_data();
+    const int width = input.get_shape()[1];
+    const int height = input.get_shape()[0];
+    const std::ptrdiff_t src_stride = input.get_strides()[0];
+    const std::ptrdiff_t dst_stride = output.get_strides()[0];
+    const int skip = border_skip(input);
+    // Czytamy tylko kolumny [skip-1, width-skip], zapisujemy [skip, width-skip)
+    const int read_end = width - skip + 1;
+    const int write_end = width - skip;
+
+    __m512 k[9];
+    for (int i = 0; i < 9; ++i) k[i] = _mm512_set1_ps(kern[i]);
+
+    for (int y = skip; y < height - skip; ++y) {
+        const float* r[3] = {src + (y - 1) * src_stride, src + y * src_stride, src + (y + 1) * src_stride};
+        float* drow = dst + y * dst_stride;
+
+        // okno x-16 .. x+31 każdego wiersza: prev (tylko ostatnia kolumna), cur, next
+        __m512 prev[3], cur[3], next[3];
+        for (int i = 0; i < 3; ++i) {
+            prev[i] = _mm512_maskz_loadu_ps(0x8000, r[i] + skip - 16);
+            cur[i] = _mm512_maskz_loadu_ps(lanes16(read_end - skip), r[i] + skip);
+            next[i] = _mm512_maskz_loadu_ps(lanes16(read_end - skip - 16), r[i] + skip + 16);
+        }
+
+        for (int x = skip; x < write_end; x += 16) {
+            __m512 acc =
+                _mm512_fmadd_ps(left(prev[0], cur[0]), k[0],
+                _mm512_fmadd_ps(cur[0], k[1],
+                _mm512_fmadd_ps(right(cur[0], next[0]), k[2],
+                _mm512_fmadd_ps(left(prev[1], cur[1]), k[3],
+                _mm512_fmadd_ps(cur[1], k[4],
+                _mm512_fmadd_ps(right(cur[1], next[1]), k[5],
+                _mm512_fmadd_ps(left(prev[2], cur[2]), k[6],
+                _mm512_fmadd_ps(cur[2], k[7],
+                _mm512_mul_ps (right(cur[2], next[2]), k[8])))))))));
+
+            _mm512_mask_storeu_ps(drow + x, lanes16(write_end - x), acc);
+
+            for (int i = 0; i < 3; ++i) {
+                prev[i] = cur[i];
+                cur[i] = next[i];
+                next[i] = _mm512_maskz_loadu_ps(lanes16(read_end - x - 32), r[i] + x + 32);
+            }
+        }
+    }
+}
+
+} //namespace matrix::ops
@@ -0,0 +1,148 @@
+#include <kernels.hpp>
+#include "XoshiroCpp.hpp"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define GS_X86 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define GS_X86 1
+#endif
+
+namespace {
+struct CpuFeatures {
+    bool sse42 = false;
+    bool avx2 = false;   // with FMA and F16C, as the avx2 kernels are built
+    bool avx512 = false; // F, VL, BW and DQ
+};
+
+#if defined(GS_X86)
+// eax, ebx, ecx, edx of a CPUID leaf; zeros past the highest leaf
+void cpuid(unsigned leaf, unsigned sub, unsigned r[4])
+{
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuidex(regs, int(leaf), int(sub));
+    for (int i = 0; i < 4; ++i) r[i] = unsigned(regs[i]);
+#else
+    if (!__get_cpuid_count(leaf, sub, &r[0], &r[1], &r[2], &r[3])) r[0] = r[1] = r[2] = r[3] = 0;
+#endif
+}
+
+// register state the OS saves on context switches (XCR0)
+unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return (unsigned long long)hi << 32 | lo;
+#endif
+}
+#endif
+
+CpuFeatures detect()
+{
+    CpuFeatures f;
+#if defined(GS_X86)
+    auto bit = [](unsigned reg, int n) { return (reg >> n & 1) != 0; };
+    unsigned r[4];
+    cpuid(0, 0, r);
+    const unsigned max_leaf = r[0];
+    if (max_leaf < 1) return f;
+
+    cpuid(1, 0, r);
+    const unsigned ecx1 = r[2];
+    f.sse42 = bit(ecx1, 20) && bit(ecx1, 23); // and POPCNT
+    const bool fma = bit(ecx1, 12), avx = bit(ecx1, 28), f16c = bit(ecx1, 29);
+
+    // AVX registers are only usable if the OS saves them: XMM|YMM, plus the
+    // opmask and upper ZMM state for AVX-512
+    const unsigned long long xcr0 = bit(ecx1, 27) ? xgetbv0() : 0;
+    const bool ymm = (xcr0 & 0x6) == 0x6;
+    const bool zmm = (xcr0 & 0xE6) == 0xE6;
+    if (max_leaf < 7) return f;
+
+    cpuid(7, 0, r);
+    const unsigned ebx7 = r[1];
+    f.avx2 = f.sse42 && avx && fma && f16c && bit(ebx7, 5) && ymm;
+    f.avx512 = f.avx2 && bit(ebx7, 16) && bit(ebx7, 17) && bit(ebx7, 30) && bit(ebx7, 31) && zmm;
+#endif
+    return f;
+}
+
+const CpuFeatures& features()
+{
+    static const CpuFeatures f = detect();
+    return f;
+}
+}
+
+namespace GrayScott::kernels {
+
+bool cpu_supports(Isa isa)
+{
+    switch (isa) {
+    case Isa::scalar: return true;
+    case Isa::sse42:  return features().sse42;
+    case Isa::avx2:   return features().avx2;
+    case Isa::avx512: return features().avx512;
+    }
+    return false;
+}
+
+const Kernels* find(Isa isa)
+{
+    if (!cpu_supports(isa)) return nullptr;
+    switch (isa) {
+    case Isa::scalar: return &scalar_kernels;
+    case Isa::sse42:  return &sse42_kernels;
+    case Isa::avx2:   return &avx2_kernels;
+    case Isa::avx512: return &avx512_kernels;
+    }
+    return nullptr;
+}
+
+const Kernels* find(std::string_view name)
+{
+    if (name == "auto") return &best();
+    if (name == "avx256") return find(Isa::avx2);
+    for (const Kernels* k : {&scalar_kernels, &sse42_kernels, &avx2_kernels, &avx512_kernels})
+        if (name == k->name) return find(k->isa);
+    return nullptr;
+}
+
+BackendType parse_backend_type(std::string_view type)
+{
+    constexpr std::string_view prefix = "threaded-";
+    if (type == "threaded") return {&best(), true};
+    if (type.starts_with(prefix)) return {find(type.substr(prefix.size())), true};
+    return {find(type), false};
+}
+
+const Kernels& best()
+{
+    static const Kernels& k = [] () -> const Kernels& {
+        for (Isa isa : {Isa::avx512, Isa::avx2, Isa::sse42})
+            if (const Kernels* k = find(isa)) return *k;
+        return scalar_kernels;
+    }();
+    return k;
+}
+
+std::vector<RngLanes> rng_substreams(uint64_t seed, size_t count)
+{
+    XoshiroCpp::Xoshiro256PlusPlus rng(seed);
+    std::vector<RngLanes> sets(count);
+    for (RngLanes& set : sets) {
+        for (int l = 0; l < rng_lanes; ++l) {
+            rng.jump();
+            const auto state = rng.serialize();
+            for (int i = 0; i < 4; ++i) set.s[i][l] = state[i];
+        }
+    }
+    return sets;
+}
+
+} // namespace GrayScott::kernels
@@ -0,0 +1,303 @@
+#include <domain.hpp>
+#include <thread_pool.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define GS_HAVE_SHM 1
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+using MatrixF32 = matrix::Matrix<float, 2>;
+
+namespace {
+// What a subdomain publishes; the corners go to the diagonal neighbours
+enum Edge : unsigned { north, south, west, east, north_west, north_east, south_west, south_east, edge_count };
+
+size_t round_up(size_t n, size_t multiple) { return (n + multiple - 1) / multiple * multiple; }
+
+// shm_open names are "/name"
+std::string shm_name(const std::string& name) { return name.starts_with('/') ? name : "/" + name; }
+
+// Spins for a while, then yields: with more processes than cores the
+// neighbour being waited for may need this one's CPU.
+inline void backoff(unsigned spins)
+{
+    if (spins >= 1024) return std::this_thread::yield();
+#if defined(__x86_64__) || defined(_M_X64)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// The field and its ghost ring as one (Nx + 2) x (Ny + 2) view
+matrix::View<float, 2> with_ring(MatrixF32& m)
+{
+    assert(m.get_layout().halo >= 1);
+    const size_t pitch = m.get_strides()[0];
+    return {m.get_data() - pitch - 1, {m.get_shape()[0] + 2, m.get_shape()[1] + 2}, {pitch, 1}};
+}
+} // namespace
+
+namespace GrayScott {
+
+// First page of the segment; the edge buffers follow, for each subdomain
+// and edge one for even and one for odd steps.
+struct SharedDomain::Header {
+    static constexpr char magic_value[8] = {'G', 'S', 'D', 'O', 'M', 'A', 'I', 'N'};
+    static constexpr uint32_t current_version = 1;
+    static constexpr size_t page = 4096;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t Nx, Ny, rows, cols;
+    uint32_t capacity; // cells of the longest edge
+    uint64_t buffer_bytes;
+    std::atomic<uint32_t> claimed;
+
+    static size_t bytes(unsigned rows, unsigned cols, size_t buffer_bytes)
+    {
+        return page + size_t(rows) * cols * edge_count * 2 * buffer_bytes;
+    }
+
+    bool valid(size_t length) const
+    {
+        return std::memcmp(magic, magic_value, sizeof(magic)) == 0 && version == current_version && rows && cols &&
+               length >= bytes(rows, cols, buffer_bytes);
+    }
+};
+
+// A cache line with the sequence counter, then capacity cells of U and
+// capacity cells of V.
+struct SharedDomain::Buffer {
+    static constexpr size_t line = 64;
+
+    alignas(line) std::atomic<uint64_t> seq;
+
+    float* cells() { return reinterpret_cast<float*>(reinterpret_cast<std::byte*>(this) + line); }
+};
+
+std::shared_ptr<SharedDomain> SharedDomain::create(const std::string& name, unsigned Nx, unsigned Ny,
+                                                   unsigned rows, unsigned cols)
+{
+    static_assert(sizeof(Header) <= Header::page);
+    static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+                  "the counters are shared between processes");
+#if defined(GS_HAVE_SHM)
+    if (rows == 0 || cols == 0 || Nx < rows || Ny < cols) return nullptr;
+    const unsigned capacity = std::max((Nx + rows - 1) / rows, (Ny + cols - 1) / cols);
+    const size_t buffer_bytes = Buffer::line + round_up(2 * size_t(capacity) * sizeof(float), Buffer::line);
+    const size_t length = Header::bytes(rows, cols, buffer_bytes);
+
+    const std::string path = shm_name(name);
+    const int fd = ::shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) return nullptr;
+    void* p = MAP_FAILED;
+    if (::ftruncate(fd, off_t(length)) == 0)
+        p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        ::shm_unlink(path.c_str());
+        return nullptr;
+    }
+
+    // the new segment is zero filled: no subdomain claimed, no step published
+    auto* h = new (p) Header;
+    h->version = Header::current_version;
+    h->Nx = Nx;
+    h->Ny = Ny;
+    h->rows = rows;
+    h->cols = cols;
+    h->capacity = capacity;
+    h->buffer_bytes = buffer_bytes;
+    std::memcpy(h->magic, Header::magic_value, sizeof(h->magic));
+
+    std::shared_ptr<SharedDomain> domain(new SharedDomain);
+    domain->header = h;
+    domain->length = length;
+    return domain;
+#else
+    (void)name, (void)Nx, (void)Ny, (void)rows, (void)cols;
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<SharedDomain> SharedDomain::open(const std::string& name)
+{
+#if defined(GS_HAVE_SHM)
+    const int fd = ::shm_open(shm_name(name).c_str(), O_RDWR, 0);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && size_t(st.st_size) >= Header::page)
+        p = ::mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return nullptr;
+
+    std::shared_ptr<SharedDomain> domain(new SharedDomain);
+    domain->header = static_cast<Header*>(p);
+    domain->length = size_t(st.st_size);
+    if (!domain->header->valid(domain->length)) return nullptr;
+    return domain;
+#else
+    (void)name;
+    return nullptr;
+#endif
+}
+
+bool SharedDomain::unlink(const std::string& name)
+{
+#if defined(GS_HAVE_SHM)
+    return ::shm_unlink(shm_name(name).c_str()) == 0;
+#else
+    (void)name;
+    return false;
+#endif
+}
+
+SharedDomain::~SharedDomain()
+{
+#if defined(GS_HAVE_SHM)
+    if (header) ::munmap(header, length);
+#endif
+}
+
+unsigned SharedDomain::Nx() const { return header->Nx; }
+unsigned SharedDomain::Ny() const { return header->Ny; }
+unsigned SharedDomain::rows() const { return header->rows; }
+unsigned SharedDomain::cols() const { return header->cols; }
+
+Subdomain SharedDomain::subdomain(unsigned index) const
+{
+    const unsigned row = index / cols(), col = index % cols();
+    const auto [r0, r1] = parallel::ThreadPool::band(0, Nx(), row, rows());
+    const auto [c0, c1] = parallel::ThreadPool::band(0, Ny(), col, cols());
+    return {row, col, unsigned(r0), unsigned(c0), unsigned(r1 - r0), unsigned(c1 - c0)};
+}
+
+std::optional<unsigned> SharedDomain::claim()
+{
+    const unsigned index = header->claimed.fetch_add(1, std::memory_order_relaxed);
+    if (index >= size()) return std::nullopt;
+    return index;
+}
+
+SharedDomain::Buffer& SharedDomain::buffer(unsigned index, unsigned edge, uint64_t step) const
+{
+    const size_t i = (size_t(index) * edge_count + edge) * 2 + (step & 1);
+    return *reinterpret_cast<Buffer*>(reinterpret_cast<std::byte*>(header) + Header::page + i * header->buffer_bytes);
+}
+
+void SharedDomain::publish(unsigned index, uint64_t step, const MatrixF32& U, const MatrixF32& V)
+{
+    const Subdomain s = subdomain(index);
+    assert(U.get_shape()[0] == s.Nx && U.get_shape()[1] == s.Ny);
+    const unsigned capacity = header->capacity;
+    const unsigned last_row = s.Nx - 1, last_col = s.Ny - 1;
+    const auto u = U.view(), v = V.view();
+
+    auto write = [&](unsigned edge, auto&& copy) {
+        Buffer& b = buffer(index, edge, step);
+        b.seq.store(2 * step + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        copy(u, b.cells());
+        copy(v, b.cells() + capacity);
+        b.seq.store(2 * step + 2, std::memory_order_release);
+    };
+    write(north, [&](const auto& f, float* out) { std::copy_n(f.row(0), s.Ny, out); });
+    write(south, [&](const auto& f, float* out) { std::copy_n(f.row(last_row), s.Ny, out); });
+    write(west, [&](const auto& f, float* out) { for (unsigned i = 0; i < s.Nx; ++i) out[i] = f(i, 0u); });
+    write(east, [&](const auto& f, float* out) { for (unsigned i = 0; i < s.Nx; ++i) out[i] = f(i, last_col); });
+    write(north_west, [&](const auto& f, float* out) { out[0] = f(0u, 0u); });
+    write(north_east, [&](const auto& f, float* out) { out[0] = f(0u, last_col); });
+    write(south_west, [&](const auto& f, float* out) { out[0] = f(last_row, 0u); });
+    write(south_east, [&](const auto& f, float* out) { out[0] = f(last_row, last_col); });
+}
+
+void SharedDomain::receive(unsigned index, uint64_t step, MatrixF32& U, MatrixF32& V)
+{
+    const Subdomain s = subdomain(index);
+    assert(U.get_shape()[0] == s.Nx && U.get_shape()[1] == s.Ny);
+    const unsigned capacity = header->capacity;
+    const unsigned n_rows = rows(), n_cols = cols();
+    const auto u = with_ring(U), v = with_ring(V);
+
+    // the given edge of the neighbour dr rows and dc columns away on the torus
+    auto read = [&](int dr, int dc, unsigned edge, auto&& copy) {
+        const unsigned row = (s.row + n_rows + dr) % n_rows, col = (s.col + n_cols + dc) % n_cols;
+        Buffer& b = buffer(row * n_cols + col, edge, step);
+        const uint64_t done = 2 * step + 2;
+        for (unsigned spins = 0;; ++spins) {
+            const uint64_t seq = b.seq.load(std::memory_order_acquire);
+            assert(seq <= done); // the neighbour cannot be two steps ahead
+            if (seq == done) {
+                copy(u, b.cells());
+                copy(v, b.cells() + capacity);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (b.seq.load(std::memory_order_relaxed) == done) return;
+            }
+            backoff(spins);
+        }
+    };
+    const unsigned below = s.Nx + 1, right = s.Ny + 1;
+    read(-1, 0, south, [&](const auto& g, const float* in) { std::copy_n(in, s.Ny, g.row(0) + 1); });
+    read(1, 0, north, [&](const auto& g, const float* in) { std::copy_n(in, s.Ny, g.row(below) + 1); });
+    read(0, -1, east, [&](const auto& g, const float* in) { for (unsigned i = 0; i < s.Nx; ++i) g(i + 1, 0u) = in[i]; });
+    read(0, 1, west, [&](const auto& g, const float* in) { for (unsigned i = 0; i < s.Nx; ++i) g(i + 1, right) = in[i]; });
+    read(-1, -1, south_east, [&](const auto& g, const float* in) { g(0u, 0u) = in[0]; });
+    read(-1, 1, south_west, [&](const auto& g, const float* in) { g(0u, right) = in[0]; });
+    read(1, -1, north_east, [&](const auto& g, const float* in) { g(below, 0u) = in[0]; });
+    read(1, 1, north_west, [&](const auto& g, const float* in) { g(below, right) = in[0]; });
+}
+
+unsigned numa_node_count()
+{
+    unsigned n = 0;
+    std::error_code ec;
+    while (std::filesystem::exists("/sys/devices/system/node/node" + std::to_string(n), ec)) ++n;
+    return std::max(n, 1u);
+}
+
+bool pin_to_numa_node(unsigned node)
+{
+#if defined(__linux__)
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    if (!std::getline(in, list)) return false;
+    // e.g. "0-15,32-47"
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::istringstream ranges(list);
+    for (std::string range; std::getline(ranges, range, ',');) {
+        unsigned first, last;
+        const int n = std::sscanf(range.c_str(), "%u-%u", &first, &last);
+        if (n < 1) continue;
+        if (n == 1) last = first;
+        for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) CPU_SET(cpu, &set);
+    }
+    return CPU_COUNT(&set) > 0 && ::sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+} // namespace GrayScott
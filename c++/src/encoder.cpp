@@ -0,0 +1,243 @@
+#include <encoder.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+constexpr size_t direct_align = 4096;
+
+size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+// BT.601 full range, 8 bit fixed point
+inline uint8_t luma(int r, int g, int b) { return uint8_t((77 * r + 150 * g + 29 * b + 128) >> 8); }
+inline uint8_t chroma_b(int r, int g, int b) { return uint8_t(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128); }
+inline uint8_t chroma_r(int r, int g, int b) { return uint8_t(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128); }
+}
+
+namespace GrayScott {
+
+FrameEncoder::FrameEncoder(StreamFormat format, unsigned width, unsigned height)
+    : format(format), width(width), height(height)
+{
+    if (format == StreamFormat::PPM) {
+        frame_header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        frame_size = frame_header.size() + size_t(width) * height * 3;
+    } else {
+        const size_t chroma = size_t((width + 1) / 2) * ((height + 1) / 2);
+        frame_header = "FRAME\n";
+        frame_size = frame_header.size() + size_t(width) * height + 2 * chroma;
+    }
+}
+
+std::unique_ptr<FrameEncoder> FrameEncoder::open(const std::string& path, StreamFormat format,
+                                                 unsigned width, unsigned height, unsigned fps, WriteMode mode)
+{
+    std::unique_ptr<FrameEncoder> enc(new FrameEncoder(format, width, height));
+    if (path == "-") mode = WriteMode::buffered;
+
+#if defined(__linux__)
+    if (mode == WriteMode::direct) {
+        enc->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (enc->fd < 0) mode = WriteMode::buffered;
+    } else if (mode == WriteMode::mmap) {
+        enc->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (enc->fd < 0) return nullptr;
+    }
+#else
+    mode = WriteMode::buffered;
+#endif
+    enc->write_mode = mode;
+
+    if (mode == WriteMode::buffered) {
+        if (path == "-") {
+#if defined(_WIN32)
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            enc->file = stdout;
+        } else {
+            enc->file = std::fopen(path.c_str(), "wb");
+            if (!enc->file) return nullptr;
+            enc->owns_file = true;
+        }
+        // frames go out as single large writes from our own buffer
+        std::setvbuf(enc->file, nullptr, _IONBF, 0);
+    }
+
+    // A direct buffer holds the unaligned tail of the previous frame in front
+    // of the next one; the mmap path encodes into the mapping instead.
+    const size_t capacity = mode == WriteMode::direct ? round_up(enc->frame_size + direct_align, direct_align)
+                                                      : enc->frame_size;
+    if (mode != WriteMode::mmap) {
+        enc->buffer = {static_cast<uint8_t*>(::operator new[](capacity, std::align_val_t(direct_align))),
+                       [](uint8_t* p) { ::operator delete[](p, std::align_val_t(direct_align)); }};
+    }
+
+    if (format == StreamFormat::Y4M) {
+        const std::string header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) +
+                                   " F" + std::to_string(fps ? fps : 30) + ":1 Ip A1:1 C420jpeg\n";
+        if (mode == WriteMode::direct) {
+            std::memcpy(enc->buffer.get(), header.data(), header.size());
+            enc->pending = header.size();
+        } else if (!enc->write_all(reinterpret_cast<const uint8_t*>(header.data()), header.size())) {
+            return nullptr;
+        }
+        enc->offset = header.size();
+    }
+    return enc;
+}
+
+FrameEncoder::~FrameEncoder()
+{
+    close();
+}
+
+void FrameEncoder::encode(uint8_t* dst, const uint8_t* rgba, size_t pitch) const
+{
+    std::memcpy(dst, frame_header.data(), frame_header.size());
+    dst += frame_header.size();
+
+    if (format == StreamFormat::PPM) {
+        for (unsigned y = 0; y < height; ++y) {
+            const uint8_t* src = rgba + y * pitch;
+            for (unsigned x = 0; x < width; ++x, dst += 3, src += 4) {
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+            }
+        }
+        return;
+    }
+
+    uint8_t* Y = dst;
+    for (unsigned y = 0; y < height; ++y) {
+        const uint8_t* src = rgba + y * pitch;
+        for (unsigned x = 0; x < width; ++x, src += 4) *Y++ = luma(src[0], src[1], src[2]);
+    }
+    // chroma from the mean of each 2x2 block, edge pixels repeated for odd sizes
+    const unsigned cw = (width + 1) / 2, ch = (height + 1) / 2;
+    uint8_t* Cb = Y;
+    uint8_t* Cr = Cb + size_t(cw) * ch;
+    for (unsigned cy = 0; cy < ch; ++cy) {
+        const uint8_t* r0 = rgba + 2 * cy * pitch;
+        const uint8_t* r1 = rgba + std::min(2 * cy + 1, height - 1) * pitch;
+        for (unsigned cx = 0; cx < cw; ++cx) {
+            const unsigned x0 = 2 * cx, x1 = std::min(2 * cx + 1, width - 1);
+            int sum[3];
+            for (int c = 0; c < 3; ++c)
+                sum[c] = r0[4 * x0 + c] + r0[4 * x1 + c] + r1[4 * x0 + c] + r1[4 * x1 + c] + 2;
+            *Cb++ = chroma_b(sum[0] >> 2, sum[1] >> 2, sum[2] >> 2);
+            *Cr++ = chroma_r(sum[0] >> 2, sum[1] >> 2, sum[2] >> 2);
+        }
+    }
+}
+
+bool FrameEncoder::write_all(const uint8_t* data, size_t n)
+{
+    if (file) {
+        ok = ok && std::fwrite(data, 1, n, file) == n;
+        return ok;
+    }
+#if defined(__linux__)
+    while (ok && n > 0) {
+        const ssize_t w = ::write(fd, data, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) ok = false;
+        else {
+            data += w;
+            n -= size_t(w);
+        }
+    }
+#endif
+    return ok;
+}
+
+bool FrameEncoder::write_frame(const uint8_t* rgba, size_t pitch)
+{
+    if (!ok || closed) return false;
+    switch (write_mode) {
+    case WriteMode::direct: return write_direct(rgba, pitch);
+    case WriteMode::mmap:   return write_mapped(rgba, pitch);
+    case WriteMode::buffered: break;
+    }
+    encode(buffer.get(), rgba, pitch);
+    offset += frame_size;
+    return write_all(buffer.get(), frame_size);
+}
+
+// Only whole 4 KiB blocks are written; the remainder moves to the front of
+// the buffer and goes out with the next frame, or unaligned on close().
+bool FrameEncoder::write_direct(const uint8_t* rgba, size_t pitch)
+{
+    encode(buffer.get() + pending, rgba, pitch);
+    offset += frame_size;
+    const size_t total = pending + frame_size;
+    const size_t aligned = total / direct_align * direct_align;
+    if (!write_all(buffer.get(), aligned)) return false;
+    pending = total - aligned;
+    std::memmove(buffer.get(), buffer.get() + aligned, pending);
+    return true;
+}
+
+// The file grows 16 frames at a time and each frame is encoded straight into
+// a short-lived shared mapping; writeback is left to the kernel.
+bool FrameEncoder::write_mapped(const uint8_t* rgba, size_t pitch)
+{
+#if defined(__linux__)
+    static const size_t page = size_t(sysconf(_SC_PAGESIZE));
+    const uint64_t end = offset + frame_size;
+    if (reserved < end) {
+        reserved = end + 15 * frame_size;
+        if (ftruncate(fd, off_t(reserved)) != 0) return ok = false;
+    }
+    const uint64_t map_begin = offset / page * page;
+    const size_t map_len = size_t(end - map_begin);
+    void* p = ::mmap(nullptr, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, off_t(map_begin));
+    if (p == MAP_FAILED) return ok = false;
+    encode(static_cast<uint8_t*>(p) + (offset - map_begin), rgba, pitch);
+    ::munmap(p, map_len);
+    offset = end;
+    return true;
+#else
+    (void)rgba;
+    (void)pitch;
+    return ok = false;
+#endif
+}
+
+bool FrameEncoder::close()
+{
+    if (closed) return ok;
+    closed = true;
+#if defined(__linux__)
+    if (fd >= 0) {
+        if (write_mode == WriteMode::direct && pending > 0) {
+            // the tail is not a whole block, finish it through the page cache
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            write_all(buffer.get(), pending);
+            pending = 0;
+        }
+        if (write_mode == WriteMode::mmap && ftruncate(fd, off_t(offset)) != 0) ok = false;
+        if (::close(fd) != 0) ok = false;
+        fd = -1;
+    }
+#endif
+    if (file) {
+        if (std::fflush(file) != 0) ok = false;
+        if (owns_file && std::fclose(file) != 0) ok = false;
+        file = nullptr;
+    }
+    return ok;
+}
+
+} // namespace GrayScott
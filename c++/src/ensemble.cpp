@@ -0,0 +1,190 @@
+#include <ensemble.hpp>
+#include <kernels.hpp>
+#include <matrix.hpp>
+#include <thread_pool.hpp>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace GrayScott {
+
+// Ensemble stepped by the kernels of one instruction set, on a pool when
+// threaded. The work of a step is the groups times their rows, split into
+// one band per worker.
+struct KernelEnsemble : public Ensemble
+{
+    static constexpr int L = kernels::ensemble_lanes;
+    // groups x Nx x Ny cells of L lanes
+    using Field = matrix::Matrix<Float32, 4>;
+
+    KernelEnsemble(const kernels::Kernels& kernels, bool threaded) : kernels(&kernels), threaded(threaded) {}
+
+    const kernels::Kernels* kernels;
+    bool threaded;
+    std::unique_ptr<parallel::ThreadPool> pool; // kept by initializes for as many threads
+
+    Params params;
+    size_t n_members = 0;
+    Field U, V, U_next, V_next;
+    std::vector<Float32> F, Fk; // L per group
+    Colormap colormap;
+    std::array<uint32_t, 256> lut_bgra;
+
+    size_t groups() const { return (n_members + L - 1) / L; }
+    size_t group_size() const { return size_t(params.Nx) * params.Ny * L; }
+
+    bool initialize(const Params& params, const std::vector<EnsembleMember>& members) override
+    {
+        if (members.empty() || params.storage != Storage::f32) return false;
+        // the same initial state as a single simulation
+        auto reference = Backend::create("naive");
+        if (!reference->initialize(params)) return false;
+        std::vector<Float32> u0(size_t(params.Nx) * params.Ny), v0(u0.size());
+        reference->read_state(u0.data(), v0.data());
+        reference.reset();
+
+        this->params = params;
+        n_members = members.size();
+        const Field::Shape shape{uint32_t(groups()), params.Nx, params.Ny, uint32_t(L)};
+        U = Field::empty(shape);
+        V = Field::empty(shape);
+        U_next = Field::empty(shape);
+        V_next = Field::empty(shape);
+        for (size_t g = 0; g < groups(); ++g) {
+            float* u = U.get_data() + g * group_size();
+            float* v = V.get_data() + g * group_size();
+            for (size_t c = 0; c < u0.size(); ++c) {
+                std::fill_n(u + c * L, L, u0[c]);
+                std::fill_n(v + c * L, L, v0[c]);
+            }
+        }
+        // unused lanes of the last group repeat the last member
+        F.resize(groups() * L);
+        Fk.resize(groups() * L);
+        for (size_t m = 0; m < F.size(); ++m) {
+            const EnsembleMember& p = members[std::min(m, n_members - 1)];
+            F[m] = p.F;
+            Fk[m] = p.F + p.k;
+        }
+        const unsigned n_threads = parallel::ThreadPool::size_for(params.threads.value_or(0));
+        if (threaded && (!pool || pool->size() != n_threads))
+            pool = std::make_unique<parallel::ThreadPool>(n_threads);
+        set_colormap(colormap);
+        return true;
+    }
+
+    size_t size() const override { return n_members; }
+
+    kernels::EnsembleArgs group_args(size_t g, float dt)
+    {
+        const size_t o = g * group_size();
+        return {U.get_data() + o, V.get_data() + o, U_next.get_data() + o, V_next.get_data() + o,
+                int(params.Ny), int(params.Nx), F.data() + g * L, Fk.data() + g * L,
+                params.Du, params.Dv, dt};
+    }
+
+    // Rows [begin, end) of the groups laid end to end
+    void step_rows(float dt, size_t begin, size_t end)
+    {
+        for (size_t g = begin / params.Nx; g * params.Nx < end; ++g) {
+            const size_t b = std::max(begin, g * params.Nx) - g * params.Nx;
+            const size_t e = std::min(end, (g + 1) * params.Nx) - g * params.Nx;
+            kernels->step_ensemble_rows(group_args(g, dt), int(b), int(e));
+        }
+    }
+
+    void gray_scott_step(float dt) override
+    {
+        const size_t rows = groups() * params.Nx;
+        if (pool)
+            pool->parallel_for(0, rows, [&](size_t b, size_t e) { step_rows(dt, b, e); });
+        else
+            step_rows(dt, 0, rows);
+        std::swap(U, U_next);
+        std::swap(V, V_next);
+    }
+
+    void gray_scott_steps(float dt, unsigned n_steps) override
+    {
+        for (; n_steps > 0; --n_steps) gray_scott_step(dt);
+    }
+
+    void set_colormap(const Colormap& colormap) override
+    {
+        this->colormap = colormap;
+        lut_bgra = colormap.bgra_lut();
+    }
+
+    // First lane of member m; its cells are L floats apart.
+    const float* member_data(const Field& f, size_t m) const
+    {
+        return f.get_data() + (m / L) * group_size() + m % L;
+    }
+
+    // Nx rows of Ny pixels, as the backends render a field
+    void render_member(size_t m, uint8_t* dst, OutputFormat format, size_t pitch) const
+    {
+        const uint32_t* lut = format == OutputFormat::BGRA8 ? lut_bgra.data() : colormap.lut.data();
+        const float scale = colormap.scale();
+        const float* u = member_data(U, m);
+        const float* v = member_data(V, m);
+        for (unsigned i = 0; i < params.Nx; ++i) {
+            uint8_t* row = dst + i * pitch;
+            for (unsigned j = 0; j < params.Ny; ++j) {
+                const size_t c = (size_t(i) * params.Ny + j) * L;
+                const float x = colormap.source == Colormap::Source::V ? v[c] : u[c] - v[c];
+                const uint32_t idx = uint32_t(std::min(std::max((x - colormap.lo) * scale, 0.0f), 255.0f));
+                if (format == OutputFormat::Gray8)
+                    row[j] = uint8_t(idx);
+                else
+                    std::memcpy(row + 4 * j, &lut[idx], 4);
+            }
+        }
+    }
+
+    static size_t bytes_per_pixel(OutputFormat format) { return format == OutputFormat::Gray8 ? 1 : 4; }
+
+    void copy_to_output(size_t member, void* output, OutputFormat format, size_t pitch) override
+    {
+        if (member >= n_members) return;
+        if (pitch == 0) pitch = params.Ny * bytes_per_pixel(format);
+        render_member(member, static_cast<uint8_t*>(output), format, pitch);
+    }
+
+    void copy_atlas_to_output(unsigned columns, void* output, OutputFormat format, size_t pitch) override
+    {
+        const size_t bpp = bytes_per_pixel(format);
+        if (pitch == 0) pitch = size_t(columns) * params.Ny * bpp;
+        auto render = [&](size_t begin, size_t end) {
+            for (size_t m = begin; m < end; ++m) {
+                uint8_t* tile = static_cast<uint8_t*>(output) + (m / columns) * params.Nx * pitch +
+                                (m % columns) * params.Ny * bpp;
+                render_member(m, tile, format, pitch);
+            }
+        };
+        if (pool)
+            pool->parallel_for(0, n_members, render);
+        else
+            render(0, n_members);
+    }
+
+    void read_state(size_t member, float* u, float* v) const override
+    {
+        if (member >= n_members) return;
+        const float* us = member_data(U, member);
+        const float* vs = member_data(V, member);
+        for (size_t c = 0; c < size_t(params.Nx) * params.Ny; ++c) {
+            u[c] = us[c * L];
+            v[c] = vs[c * L];
+        }
+    }
+};
+
+std::unique_ptr<Ensemble> Ensemble::create(const std::string& type)
+{
+    const auto [k, threaded] = kernels::parse_backend_type(type);
+    if (!k) return nullptr;
+    return std::make_unique<KernelEnsemble>(*k, threaded);
+}
+
+} // namespace GrayScott
@@ -1,125 +1,927 @@
 
 #include <gray_scott.hpp>
+#include <checkpoint.hpp>
+#include <domain.hpp>
+#include <kernels.hpp>
 #include <matrix.hpp>
+#include <matrix_ops.hpp>
+#include <thread_pool.hpp>
+#include <trace.hpp>
+#include "XoshiroCpp.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <limits>
+#include <vector>
 
 using Float32 = float;
 using MatrixF32 = matrix::Matrix<Float32, 2>;
 
+namespace {
+// The initial state is generated in bands of init_band_rows rows, each from
+// its own set of kernels::rng_substreams, so it depends on the seed only and
+// not on which thread fills which band.
+constexpr unsigned init_band_rows = 32;
+} // namespace
+
 namespace GrayScott {
+// Linear ramp through a few control points: black, deep blue, cyan, yellow, white.
+std::array<uint32_t, 256> Colormap::default_lut()
+{
+    struct Stop { float at; uint8_t r, g, b; };
+    static constexpr Stop stops[] = {
+        {0.00f,   0,   0,   0},
+        {0.25f,  20,  40, 150},
+        {0.50f,  40, 200, 220},
+        {0.75f, 250, 220,  60},
+        {1.00f, 255, 255, 255},
+    };
+    std::array<uint32_t, 256> lut;
+    for (size_t i = 0; i < lut.size(); ++i) {
+        const float t = i / 255.0f;
+        size_t s = 0;
+        while (s + 2 < std::size(stops) && t > stops[s + 1].at) ++s;
+        const Stop& a = stops[s];
+        const Stop& b = stops[s + 1];
+        const float w = (t - a.at) / (b.at - a.at);
+        auto mix = [w](uint8_t x, uint8_t y) { return uint32_t(x + (y - x) * w + 0.5f); };
+        lut[i] = mix(a.r, b.r) | mix(a.g, b.g) << 8 | mix(a.b, b.b) << 16 | 0xFFu << 24;
+    }
+    return lut;
+}
+
+// A field and the buffer its next step is written to. A step reads front and
+// writes back, then swap() promotes back to front by exchanging the two
+// matrices (a move of their pointers and shapes), so the step loop never
+// allocates or copies a field.
+template <typename M>
+struct DoubleBuffer {
+    M front, back;
+
+    void reset(M initial)
+    {
+        front = std::move(initial);
+        back = front.similar();
+    }
+
+    void release()
+    {
+        front = M();
+        back = M();
+    }
+
+    void swap() noexcept { std::swap(front, back); }
+};
+
+std::array<uint32_t, 256> Colormap::bgra_lut() const
+{
+    std::array<uint32_t, 256> bgra;
+    for (size_t i = 0; i < lut.size(); ++i) {
+        const uint32_t c = lut[i];
+        bgra[i] = (c & 0xFF00FF00u) | ((c >> 16) & 0xFFu) | ((c & 0xFFu) << 16);
+    }
+    return bgra;
+}
+
+Float32 Colormap::scale() const
+{
+    const float range = hi - lo;
+    if (!(range > 0.0f)) return 0.0f;
+    // a denormal range would give inf, and inf * 0 at x == lo a NaN index
+    return std::min(255.0f / range, std::numeric_limits<float>::max());
+}
+
 struct NaiveBackend : public Backend
 {
-    MatrixF32 U, V, U_new, V_new, U_lap, V_lap, lap_kernel;
+    // U and V carry a one cell ghost ring, refreshed before every step, so
+    // the grid wraps around like a torus and tiles seamlessly. Rows start on
+    // a cache line and are padded to a whole number of them.
+    static constexpr matrix::Layout field_layout{.halo = 1, .row_align = 64};
+
+    DoubleBuffer<MatrixF32> U, V;
+    MatrixF32 U_lap, V_lap, lap_kernel;
     Params params;
+    // Allocator of the fields, nullptr for the default one
+    virtual std::shared_ptr<const matrix::Allocator> field_allocator(const Params& params)
+    {
+        if (params.pages == matrix::Pages::normal) return nullptr;
+        return std::make_shared<matrix::Allocator>(matrix::Allocator{.pages = params.pages});
+    }
+
+    // Runs body over [0, n) split in ranges, on the workers of threaded backends
+    virtual void parallel_for(size_t n, const std::function<void(size_t, size_t)>& body) { body(0, n); }
+
+    // The part of a larger grid the fields hold, for a subdomain
+    // (SubdomainBackend); they start as that part of the larger grid's
+    // initial state. Unset, the fields are the whole grid.
+    struct Window {
+        unsigned row0, col0; // first row and column
+        unsigned Nx, Ny;     // size of the whole grid
+    };
+    std::optional<Window> window;
+
     std::pair<MatrixF32, MatrixF32> initialize_UV(const Params& params)
     {
-        auto U = matrix::ones<float>(params.Nx, params.Ny);
-        auto V = matrix::zeros<float>(params.Nx, params.Ny);
+        const auto allocator = field_allocator(params);
+        auto U = MatrixF32::empty({params.Nx, params.Ny}, field_layout, allocator);
+        auto V = MatrixF32::empty({params.Nx, params.Ny}, field_layout, allocator);
 
-        auto initial_noise = params.initial_noise;
-        srand(params.seed.value_or(0));
+        // the state is generated in the whole grid's coordinates, rows and
+        // columns outside the window are drawn and dropped
+        const Window w = window.value_or(Window{0, 0, params.Nx, params.Ny});
+        constexpr size_t lanes = kernels::rng_lanes;
+        const unsigned n_bands = (w.Nx + init_band_rows - 1) / init_band_rows;
+        const auto streams = kernels::rng_substreams(params.seed.value_or(0), n_bands + 1);
 
-        // Initialize U and V with some pattern plus noise
-        auto vU = U.view();
-        auto vV = V.view();
-        for (unsigned i = 0; i < params.Nx; ++i) {
-            for (unsigned j = 0; j < params.Ny; ++j) {
-                vU[i][j] = 1.0 + params.initial_noise * ((double)rand() / RAND_MAX - 0.5);
-                vV[i][j] = params.initial_noise * ((double)rand() / RAND_MAX - 0.5);
-            }
+        // squares of U = 0.5, V = 0.25 as {row, col}, from the last set
+        const unsigned Ns = std::max(params.Ns, 1u);
+        std::vector<std::pair<unsigned, unsigned>> squares;
+        if (params.pattern == Pattern::square) {
+            squares.emplace_back(w.Nx / 2 - std::min(Ns, w.Nx) / 2, w.Ny / 2 - std::min(Ns, w.Ny) / 2);
+        } else if (params.pattern == Pattern::spots) {
+            const auto& last = streams.back().s;
+            XoshiroCpp::Xoshiro256PlusPlus rng({last[0][0], last[1][0], last[2][0], last[3][0]});
+            const size_t count = std::max<size_t>(size_t(w.Nx) * w.Ny / (size_t(Ns) * Ns * 32), 1);
+            const uint64_t rows = w.Nx - std::min(Ns, w.Nx) + 1, cols = w.Ny - std::min(Ns, w.Ny) + 1;
+            for (size_t i = 0; i < count; ++i) squares.emplace_back(unsigned(rng() % rows), unsigned(rng() % cols));
+            std::sort(squares.begin(), squares.end());
         }
+
+        // Whole rows of the allocation, ghost cells and padding included, are
+        // written by the band that owns them; the last band also covers the
+        // vector a kernel may read past the last row.
+        const size_t pitch = U.get_strides()[0];
+        const size_t halo = field_layout.halo;
+        const size_t tail = field_layout.row_align / sizeof(float);
+        const auto uniform = kernels::best().uniform;
+        const unsigned first_band = w.row0 / init_band_rows;
+        const unsigned last_band = (w.row0 + params.Nx + init_band_rows - 1) / init_band_rows;
+        parallel_for(last_band - first_band, [&](size_t band_begin, size_t band_end) {
+            // U then V noise of a row, drawn as whole steps of the lanes
+            const size_t draws = (2 * size_t(w.Ny) + 2 * lanes - 1) / (2 * lanes) * (2 * lanes);
+            std::vector<float> noise(draws);
+            for (size_t band = first_band + band_begin; band < first_band + band_end; ++band) {
+                auto rng = streams[band];
+                // rows of the band in the window, in the fields' coordinates
+                const size_t band_row = band * init_band_rows;
+                const size_t row_begin = std::max<size_t>(band_row, w.row0) - w.row0;
+                const size_t row_end = std::min<size_t>(band_row + init_band_rows, w.row0 + params.Nx) - w.row0;
+                const size_t fill_begin = row_begin == 0 ? 0 : (row_begin + halo) * pitch;
+                const size_t fill_end = row_end == params.Nx ? U.allocated_size() + tail : (row_end + halo) * pitch;
+                std::fill(U.get_data() - U.get_origin() + fill_begin, U.get_data() - U.get_origin() + fill_end, 1.0f);
+                std::fill(V.get_data() - V.get_origin() + fill_begin, V.get_data() - V.get_origin() + fill_end, 0.0f);
+
+                for (size_t i = band_row; i < row_begin + w.row0; ++i) uniform(rng, noise.data(), draws);
+                for (size_t i = row_begin; i < row_end; ++i) {
+                    float* u = U.get_data() + i * pitch;
+                    float* v = V.get_data() + i * pitch;
+                    // the squares starting in rows (r - Ns, r] of the whole grid,
+                    // clipped to the window's columns
+                    const size_t r = i + w.row0;
+                    const unsigned top = r + 1 > Ns ? unsigned(r + 1 - Ns) : 0;
+                    auto it = std::lower_bound(squares.begin(), squares.end(), std::make_pair(top, 0u));
+                    for (; it != squares.end() && it->first <= r; ++it) {
+                        const unsigned lo = std::max(it->second, w.col0);
+                        const unsigned hi = std::min({it->second + Ns, w.Ny, w.col0 + params.Ny});
+                        if (lo >= hi) continue;
+                        std::fill(u + (lo - w.col0), u + (hi - w.col0), 0.5f);
+                        std::fill(v + (lo - w.col0), v + (hi - w.col0), 0.25f);
+                    }
+                    uniform(rng, noise.data(), draws);
+                    const float a = params.initial_noise;
+                    for (unsigned j = 0; j < params.Ny; ++j) {
+                        u[j] += a * (noise[w.col0 + j] - 0.5f);
+                        v[j] += a * (noise[w.Ny + w.col0 + j] - 0.5f);
+                    }
+                }
+            }
+        });
         return {std::move(U), std::move(V)};
     }
 
     bool initialize(const Params& params) override
     {
-        std::tie(U, V) = initialize_UV(params);
-        U_new = U.similar();
-        V_new = V.similar();
-        U_lap = U.similar();
-        V_lap = V.similar();
+        if (params.storage != Storage::f32) return false;
+        if (!initialize_state(params)) return false;
+        // only this step goes through Laplacian temporaries; the fused
+        // kernels override initialize
+        U_lap = matrix::zeros<float>(params.Nx, params.Ny);
+        V_lap = matrix::zeros<float>(params.Nx, params.Ny);
+        return true;
+    }
+
+    // Set while restore_checkpoint runs initialize: fields come from the
+    // mapping instead of initialize_UV.
+    std::shared_ptr<MappedCheckpoint> restoring;
+
+    bool initialize_state(const Params& params)
+    {
+        if (!restoring) {
+            // the old fields go first, so a matrix::BufferPool can hand them out again
+            U.release();
+            V.release();
+            auto [U0, V0] = initialize_UV(params);
+            U.reset(std::move(U0));
+            V.reset(std::move(V0));
+        } else if (params.storage == Storage::f32) {
+            if (!adopt_checkpoint(params, U, V)) return false;
+        } else {
+            // 16-bit fields are adopted by the kernel that stores them
+            U.release();
+            V.release();
+        }
         lap_kernel = matrix::empty<float>(3, 3);
 
-        const float kernel[]  = { 
-            .05f, .02f, .05f,
-            .2f, -1, .2f,
-            .05f, .2f, .05f
-        };
-        memcpy(lap_kernel.get_data(), kernel, sizeof(kernel));
+        const auto kernel = kernels::laplacian_stencil.weights();
+        memcpy(lap_kernel.get_data(), kernel.data(), sizeof(kernel));
         this->params = params;
+        set_colormap(colormap);
+        return true;
+    }
+
+    // The mapped planes become the front buffers, provided they were saved
+    // in the layout these fields use; the back buffers come from
+    // field_allocator, as in initialize_UV.
+    template <typename T>
+    bool adopt_checkpoint(const Params& params, DoubleBuffer<matrix::Matrix<T, 2>>& U,
+                          DoubleBuffer<matrix::Matrix<T, 2>>& V)
+    {
+        const auto& h = restoring->header();
+        auto [U0, V0] = restoring->fields<T>();
+        if (h.element_bytes != sizeof(T) || U0.get_strides()[0] != h.pitch || U0.get_origin() != h.origin)
+            return false;
+        const auto allocator = field_allocator(params);
+        U.release();
+        V.release();
+        U.front = std::move(U0);
+        V.front = std::move(V0);
+        U.back = matrix::Matrix<T, 2>::empty(U.front.get_shape(), field_layout, allocator);
+        V.back = matrix::Matrix<T, 2>::empty(V.front.get_shape(), field_layout, allocator);
         return true;
     }
 
-    void conv2d(const MatrixF32& input, const MatrixF32& kernel, MatrixF32& output)
+    bool restore_checkpoint(const std::string& path, uint64_t* step) override
     {
-        const auto n_rows = input.get_shape()[0];
-        const auto n_cols = input.get_shape()[1];
+        restoring = MappedCheckpoint::map(path);
+        if (!restoring) return false;
+        const auto& h = restoring->header();
+        const bool ok = h.layout() == field_layout && initialize(h.params());
+        if (ok && step) *step = h.step;
+        restoring.reset();
+        return ok;
+    }
+
+    std::future<bool> save_checkpoint(const std::string& path, uint64_t step) const override
+    {
+        return checkpoint_fields(path, params, step, U.front, V.front);
+    }
 
-        auto inp = input.view();
-        auto outp = output.view();
-        auto kern = kernel.view();
+    // Computes output rows [row_begin, row_end); neighbours outside the grid
+    // come from the input's ghost ring.
+    void conv2d(const MatrixF32& input, const MatrixF32& kernel, MatrixF32& output,
+                unsigned row_begin, unsigned row_end)
+    {
+        const int n_cols = input.get_shape()[1];
+        const std::ptrdiff_t stride = input.get_strides()[0];
+
+        const auto kern = kernel.view();
 
-        for (unsigned i = 1; i < n_rows - 1; ++i) {
-            for (unsigned j = 1; j < n_cols - 1; ++j) {
+        for (int i = row_begin; i < int(row_end); ++i) {
+            float* out = output.row(i);
+            for (int j = 0; j < n_cols; ++j) {
                 float sum = 0.0f;
                 for (int ki = -1; ki <= 1; ++ki) {
+                    const float* row = input.get_data() + (i + ki) * stride;
                     for (int kj = -1; kj <= 1; ++kj) {
-                        sum += inp[i + ki][j + kj] * kern[ki + 1][kj + 1];
+                        sum += row[j + kj] * kern(ki + 1, kj + 1);
                     }
                 }
-                outp[i][j] = sum;
+                out[j] = sum;
             }
         }
     }
 
+    // Promotes the back buffers to the current state, O(1).
+    virtual void swap_buffers()
+    {
+        U.swap();
+        V.swap();
+    }
+
+    virtual void refresh_halos()
+    {
+        U.front.refresh_halo();
+        V.front.refresh_halo();
+    }
+
     void gray_scott_step(float dt) override
     {
-        conv2d(U, lap_kernel, U_lap);
-        conv2d(V, lap_kernel, V_lap);
-        auto u_view = U.view();
-        auto v_view = V.view();
-        auto u_new_view = U_new.view();
-        auto v_new_view = V_new.view();
-        auto u_lap_view = U_lap.view();
-        auto v_lap_view = V_lap.view();
+        trace::Scope<"step"> scope;
+        refresh_halos();
+        step_rows(dt, 0, params.Nx);
+        swap_buffers();
+    }
 
-        for (unsigned i = 0; i < params.Nx; ++i) {
+    void gray_scott_steps(float dt, unsigned n_steps) override
+    {
+        const unsigned T = std::max(params.time_block.value_or(1), 1u);
+        for (; n_steps >= T; n_steps -= T) advance_blocked(dt, T);
+        for (; n_steps > 0; --n_steps) gray_scott_step(dt);
+    }
+
+    // Advances the state by T steps. Kernels that step from raw row pointers
+    // override this with a temporally blocked pass.
+    virtual void advance_blocked(float dt, unsigned T)
+    {
+        for (unsigned s = 0; s < T; ++s) gray_scott_step(dt);
+    }
+
+    // Writes rows [row_begin, row_end) of the back buffers from the front
+    // ones, whose halos must be fresh. Rows are independent of each other, so
+    // disjoint ranges may run concurrently.
+    virtual void step_rows(float dt, unsigned row_begin, unsigned row_end)
+    {
+        conv2d(U.front, lap_kernel, U_lap, row_begin, row_end);
+        conv2d(V.front, lap_kernel, V_lap, row_begin, row_end);
+        const MatrixF32& u = U.front;
+        const MatrixF32& v = V.front;
+        const float Du = params.Du, Dv = params.Dv, F = params.F, Fk = params.F + params.k;
+        matrix::assign_rows(U.back, u + (Du * U_lap - u * v * v + F * (1.0f - u)) * dt, row_begin, row_end);
+        matrix::assign_rows(V.back, v + (Dv * V_lap + u * v * v - Fk * v) * dt, row_begin, row_end);
+    }
+
+    struct OutputTarget {
+        uint8_t* data;
+        OutputFormat format;
+        size_t pitch;
+
+        static size_t bytes_per_pixel(OutputFormat format) {
+            return format == OutputFormat::Gray8 ? 1 : 4;
+        }
+        uint8_t* row(unsigned r) const { return data + r * pitch; }
+    };
+
+    Colormap colormap;
+    std::array<uint32_t, 256> lut_bgra;
+
+    void set_colormap(const Colormap& colormap) override
+    {
+        this->colormap = colormap;
+        lut_bgra = colormap.bgra_lut();
+    }
+
+    OutputTarget make_target(void* output, OutputFormat format, size_t pitch) const
+    {
+        if (pitch == 0) pitch = params.Ny * OutputTarget::bytes_per_pixel(format);
+        return {static_cast<uint8_t*>(output), format, pitch};
+    }
+
+    // colormap index of a cell, the scalar reference of the SIMD renderers
+    inline uint32_t color_index(float u, float v) const
+    {
+        const float x = colormap.source == Colormap::Source::V ? v : u - v;
+        const float t = (x - colormap.lo) * colormap.scale();
+        return uint32_t(std::min(std::max(t, 0.0f), 255.0f));
+    }
+
+    void render_rows(const MatrixF32& U, const MatrixF32& V, unsigned row_begin, unsigned row_end,
+                     const OutputTarget& out) const
+    {
+        const uint32_t* lut = out.format == OutputFormat::BGRA8 ? lut_bgra.data() : colormap.lut.data();
+        for (unsigned i = row_begin; i < row_end; ++i) {
+            const float* u = U.get_data() + i * U.get_strides()[0];
+            const float* v = V.get_data() + i * V.get_strides()[0];
+            uint8_t* dst = out.row(i);
             for (unsigned j = 0; j < params.Ny; ++j) {
-                float u = u_view[i][j];
-                float v = v_view[i][j];
-                float uvv = u * v * v;
-                float du = params.Du * u_lap_view[i][j] - uvv + params.F * (1 - u);
-                float dv = params.Dv * v_lap_view[i][j] + uvv - (params.F + params.k) * v;
-                u_new_view[i][j] = u + du * dt;
-                v_new_view[i][j] = v + dv * dt;
+                const uint32_t idx = color_index(u[j], v[j]);
+                if (out.format == OutputFormat::Gray8) {
+                    dst[j] = uint8_t(idx);
+                } else {
+                    memcpy(dst + 4 * j, &lut[idx], 4);
+                }
+            }
+        }
+    }
+
+    virtual void copy_rows_to_output(unsigned row_begin, unsigned row_end, const OutputTarget& out)
+    {
+        render_rows(U.front, V.front, row_begin, row_end, out);
+    }
+
+    // Steps rows [row_begin, row_end) and renders the new values of those rows.
+    virtual void step_rows_to_output(float dt, unsigned row_begin, unsigned row_end, const OutputTarget& out)
+    {
+        step_rows(dt, row_begin, row_end);
+        render_rows(U.back, V.back, row_begin, row_end, out);
+    }
+
+    void copy_to_output(void* output, OutputFormat format, size_t pitch) override
+    {
+        copy_rows_to_output(0, params.Nx, make_target(output, format, pitch));
+    }
+
+    void gray_scott_step_to_output(float dt, void* output, OutputFormat format, size_t pitch) override
+    {
+        trace::Scope<"step"> scope;
+        refresh_halos();
+        step_rows_to_output(dt, 0, params.Nx, make_target(output, format, pitch));
+        swap_buffers();
+    }
+
+    FieldView front() const override
+    {
+        return {U.front.get_data(), V.front.get_data(), Storage::f32,
+                size_t(U.front.get_strides()[0]), params.Nx, params.Ny};
+    }
+
+    void read_state(float* u, float* v) const override
+    {
+        for (size_t r = 0; r < U.front.row_count(); ++r) {
+            std::copy_n(U.front.get_data() + U.front.row_offset(r), params.Ny, u + r * params.Ny);
+            std::copy_n(V.front.get_data() + V.front.row_offset(r), params.Ny, v + r * params.Ny);
+        }
+    }
+};
+
+// Fused step, render and temporally blocked pass through a kernels::Kernels
+// table, the row kernels built for one instruction set (kernels.hpp).
+struct KernelBackend : public NaiveBackend
+{
+    using Matrix16 = matrix::Matrix<uint16_t, 2>;
+
+    explicit KernelBackend(const kernels::Kernels& kernels) : kernels(&kernels) {}
+
+    const kernels::Kernels* kernels;
+
+    // Fields in reduced precision storage (Params::storage f16/bf16); the
+    // fp32 fields are released then.
+    DoubleBuffer<Matrix16> U16, V16;
+
+    bool initialize(const Params& params) override
+    {
+        if (!initialize_state(params)) return false;
+        activity.reset();
+        if (params.activity_threshold && params.storage == Storage::f32) init_activity();
+        if (restoring && params.storage != Storage::f32) return adopt_checkpoint(params, U16, V16);
+        if (params.storage != Storage::f32) narrow_fields();
+        return true;
+    }
+
+    void narrow_fields()
+    {
+        auto narrow = [&](const MatrixF32& src) {
+            auto dst = Matrix16::empty(src.get_shape(), field_layout, src.get_allocator());
+            for (size_t r = 0; r < src.row_count(); ++r)
+                kernels->narrow(params.storage, src.get_data() + src.row_offset(r),
+                                dst.get_data() + dst.row_offset(r), src.get_shape()[1]);
+            return dst;
+        };
+        U16.reset(narrow(U.front));
+        V16.reset(narrow(V.front));
+        U.release();
+        V.release();
+    }
+
+    std::future<bool> save_checkpoint(const std::string& path, uint64_t step) const override
+    {
+        if (params.storage == Storage::f32) return NaiveBackend::save_checkpoint(path, step);
+        return checkpoint_fields(path, params, step, U16.front, V16.front);
+    }
+
+    void swap_buffers() override
+    {
+        if (activity) settle_tiles();
+        if (params.storage == Storage::f32) return NaiveBackend::swap_buffers();
+        U16.swap();
+        V16.swap();
+    }
+
+    void refresh_halos() override
+    {
+        if (params.storage == Storage::f32) return NaiveBackend::refresh_halos();
+        U16.front.refresh_halo();
+        V16.front.refresh_halo();
+    }
+
+    FieldView front() const override
+    {
+        if (params.storage == Storage::f32) return NaiveBackend::front();
+        return {U16.front.get_data(), V16.front.get_data(), params.storage,
+                size_t(U16.front.get_strides()[0]), params.Nx, params.Ny};
+    }
+
+    void read_state(float* u, float* v) const override
+    {
+        if (params.storage == Storage::f32) return NaiveBackend::read_state(u, v);
+        for (size_t r = 0; r < U16.front.row_count(); ++r) {
+            kernels->widen(params.storage, U16.front.get_data() + U16.front.row_offset(r), u + r * params.Ny, params.Ny);
+            kernels->widen(params.storage, V16.front.get_data() + V16.front.row_offset(r), v + r * params.Ny, params.Ny);
+        }
+    }
+
+    kernels::StepCoeffs make_coeffs(float dt) const
+    {
+        kernels::StepCoeffs c;
+        std::copy_n(lap_kernel.get_data(), 9, c.lap);
+        c.Du = params.Du;
+        c.Dv = params.Dv;
+        c.F = params.F;
+        c.k = params.k;
+        c.dt = dt;
+        return c;
+    }
+
+    static kernels::RenderTarget render_target(const Colormap& colormap, const uint32_t* lut, const OutputTarget& out)
+    {
+        return {out.data, out.pitch, out.format, lut, colormap.lo, colormap.scale(),
+                colormap.source == Colormap::Source::U_minus_V};
+    }
+
+    kernels::RenderTarget render_target(const OutputTarget& out) const
+    {
+        const uint32_t* lut = out.format == OutputFormat::BGRA8 ? lut_bgra.data() : colormap.lut.data();
+        return render_target(colormap, lut, out);
+    }
+
+    void copy_rows_to_output(unsigned row_begin, unsigned row_end, const OutputTarget& out) override
+    {
+        const FieldView f = front();
+        kernels->render_rows(f.storage, f.U, f.V, f.pitch, f.cols, row_begin, row_end, render_target(out));
+    }
+
+    void step_rows_with(float dt, unsigned row_begin, unsigned row_end, const kernels::RenderTarget* out)
+    {
+        const auto c = make_coeffs(dt);
+        if (params.storage == Storage::f32)
+            kernels->step_rows(Storage::f32, U.front.get_data(), V.front.get_data(), U.back.get_data(),
+                               V.back.get_data(), U.front.get_strides()[0], params.Ny, row_begin, row_end, c, out);
+        else
+            kernels->step_rows(params.storage, U16.front.get_data(), V16.front.get_data(), U16.back.get_data(),
+                               V16.back.get_data(), U16.front.get_strides()[0], params.Ny, row_begin, row_end, c, out);
+    }
+
+    void step_rows(float dt, unsigned row_begin, unsigned row_end) override
+    {
+        if (activity) return step_awake_tiles(dt, row_begin, row_end);
+        step_rows_with(dt, row_begin, row_end, nullptr);
+    }
+
+    void step_rows_to_output(float dt, unsigned row_begin, unsigned row_end, const OutputTarget& out) override
+    {
+        const auto target = render_target(out);
+        if (activity) {
+            // sleeping tiles are not stepped but still rendered
+            step_awake_tiles(dt, row_begin, row_end);
+            kernels->render_rows(Storage::f32, U.back.get_data(), V.back.get_data(), U.back.get_strides()[0],
+                                 params.Ny, row_begin, row_end, target);
+            return;
+        }
+        step_rows_with(dt, row_begin, row_end, &target);
+    }
+
+    // Activity mask (Params::activity_threshold), fp32 fields only. Workers
+    // step the awake tiles of their rows and record the largest change of
+    // each; settle_tiles then, between the step and the swap, puts quiet
+    // tiles to sleep and wakes the neighbours of active ones. A tile going to
+    // sleep gets its new values copied into the old buffer too, so while it
+    // sleeps both buffers hold the same cells and skipping it takes no work.
+    static constexpr unsigned activity_tile_rows = 16;
+    static constexpr unsigned activity_tile_cols = kernels::change_cols;
+
+    struct ActivityMask {
+        unsigned rows, cols; // tiles
+        // largest |dU|, |dV| of the tile's last step, as float bits: workers
+        // sharing a tile take the maximum with integer compares
+        std::unique_ptr<std::atomic<uint32_t>[]> change;
+        std::vector<unsigned> sleep; // steps the tile still skips
+        std::vector<uint8_t> stepped;
+        ActivityStats stats;
+    };
+    std::unique_ptr<ActivityMask> activity;
+
+    void init_activity()
+    {
+        activity = std::make_unique<ActivityMask>();
+        auto& a = *activity;
+        a.rows = (params.Nx + activity_tile_rows - 1) / activity_tile_rows;
+        a.cols = (params.Ny + activity_tile_cols - 1) / activity_tile_cols;
+        a.change = std::make_unique<std::atomic<uint32_t>[]>(size_t(a.rows) * a.cols);
+        a.sleep.assign(size_t(a.rows) * a.cols, 0);
+        a.stepped.resize(a.sleep.size());
+    }
+
+    float tile_change(size_t t) const
+    {
+        const uint32_t bits = activity->change[t].load(std::memory_order_relaxed);
+        float x;
+        std::memcpy(&x, &bits, sizeof(x));
+        return x;
+    }
+
+    // Runs of awake tiles in a tile row are stepped as one block of rows, so
+    // a fully awake grid is stepped row by row as without the mask.
+    void step_awake_tiles(float dt, unsigned row_begin, unsigned row_end)
+    {
+        auto& a = *activity;
+        const auto c = make_coeffs(dt);
+        const std::ptrdiff_t stride = U.front.get_strides()[0];
+        thread_local std::vector<float> change;
+        change.assign(a.cols, 0.0f);
+        for (unsigned ty = row_begin / activity_tile_rows; ty * activity_tile_rows < row_end; ++ty) {
+            const unsigned rb = std::max(row_begin, ty * activity_tile_rows);
+            const unsigned re = std::min(row_end, (ty + 1) * activity_tile_rows);
+            const unsigned* sleep = a.sleep.data() + size_t(ty) * a.cols;
+            for (unsigned tx = 0; tx < a.cols;) {
+                if (sleep[tx]) {
+                    ++tx;
+                    continue;
+                }
+                unsigned end = tx + 1;
+                while (end < a.cols && !sleep[end]) ++end;
+                const unsigned x0 = tx * activity_tile_cols;
+                const unsigned x1 = std::min(end * activity_tile_cols, params.Ny);
+                kernels->step_rows_tracked(U.front.get_data() + x0, V.front.get_data() + x0, U.back.get_data() + x0,
+                                           V.back.get_data() + x0, stride, x1 - x0, rb, re, c, change.data() + tx);
+                tx = end;
+            }
+            // workers may share a tile row at the ends of their bands
+            for (unsigned tx = 0; tx < a.cols; ++tx) {
+                uint32_t bits;
+                std::memcpy(&bits, &change[tx], sizeof(bits));
+                std::atomic<uint32_t>& m = a.change[size_t(ty) * a.cols + tx];
+                uint32_t seen = m.load(std::memory_order_relaxed);
+                while (seen < bits && !m.compare_exchange_weak(seen, bits, std::memory_order_relaxed)) {}
+                change[tx] = 0.0f;
+            }
+        }
+    }
+
+    // Copies the new cells of a tile going to sleep over its old ones.
+    void copy_tile_back(unsigned ty, unsigned tx)
+    {
+        const unsigned x0 = tx * activity_tile_cols;
+        const unsigned w = std::min(activity_tile_cols, params.Ny - x0);
+        const std::ptrdiff_t stride = U.front.get_strides()[0];
+        const unsigned re = std::min(params.Nx, (ty + 1) * activity_tile_rows);
+        for (unsigned y = ty * activity_tile_rows; y < re; ++y) {
+            const std::ptrdiff_t o = y * stride + x0;
+            std::copy_n(U.back.get_data() + o, w, U.front.get_data() + o);
+            std::copy_n(V.back.get_data() + o, w, V.front.get_data() + o);
+        }
+    }
+
+    void settle_tiles()
+    {
+        auto& a = *activity;
+        const float threshold = *params.activity_threshold;
+        for (size_t t = 0; t < a.sleep.size(); ++t) a.stepped[t] = a.sleep[t] == 0;
+        // the tile and its eight neighbours on the torus; sleeping ones
+        // keep the change that put them to sleep
+        auto quiet = [&](unsigned ty, unsigned tx) {
+            for (unsigned dy : {a.rows - 1, 0u, 1u})
+                for (unsigned dx : {a.cols - 1, 0u, 1u})
+                    if (!(tile_change(size_t((ty + dy) % a.rows) * a.cols + (tx + dx) % a.cols) < threshold))
+                        return false;
+            return true;
+        };
+        for (unsigned ty = 0; ty < a.rows; ++ty) {
+            for (unsigned tx = 0; tx < a.cols; ++tx) {
+                const size_t t = size_t(ty) * a.cols + tx;
+                if (a.stepped[t]) {
+                    ++a.stats.tiles_stepped;
+                    if (params.activity_skip > 0 && quiet(ty, tx)) {
+                        a.sleep[t] = params.activity_skip;
+                        copy_tile_back(ty, tx);
+                    }
+                } else {
+                    ++a.stats.tiles_skipped;
+                    if (--a.sleep[t] > 0 && !quiet(ty, tx)) a.sleep[t] = 0;
+                }
             }
         }
+        for (size_t t = 0; t < a.sleep.size(); ++t)
+            if (a.sleep[t] == 0) a.change[t].store(0, std::memory_order_relaxed);
     }
 
-    void copy_to_output(void* output, int format) override
+    ActivityStats activity_stats() const override
     {
-        // Implement the copy to output functionality
+        return activity ? activity->stats : ActivityStats{};
+    }
+
+    // Temporal blocking (kernels::TileArgs): per worker ring buffers of
+    // T-1 intermediate steps, fp32 storage only.
+    struct TileScratch {
+        MatrixF32 U, V; // (T-1) levels of tile_ring_rows rows each, with ghost columns
+    };
+    std::vector<TileScratch> scratch;
+
+    void reserve_scratch(size_t n_workers, unsigned T)
+    {
+        const unsigned rows = (T - 1) * kernels::tile_ring_rows;
+        const MatrixF32::Shape shape{uint32_t(rows), params.Ny};
+        if (scratch.size() == n_workers && scratch[0].U.get_shape() == shape) return;
+        scratch.resize(n_workers);
+        for (auto& s : scratch) {
+            s.U = MatrixF32::empty(shape, field_layout);
+            s.V = MatrixF32::empty(shape, field_layout);
+        }
+    }
+
+    // Writes rows [row_begin, row_end) of the back buffers as the front ones
+    // advanced by T steps. Front halos must be fresh.
+    void advance_tile(unsigned T, int row_begin, int row_end, TileScratch& s, const kernels::StepCoeffs& c)
+    {
+        const kernels::TileArgs a{U.front.get_data(), V.front.get_data(), U.back.get_data(), V.back.get_data(),
+                                  std::ptrdiff_t(U.front.get_strides()[0]), int(params.Ny), int(params.Nx), T,
+                                  row_begin, row_end, s.U.get_data(), s.V.get_data(),
+                                  std::ptrdiff_t(s.U.get_strides()[0])};
+        kernels->advance_tile(a, c);
+    }
+
+    void advance_blocked(float dt, unsigned T) override
+    {
+        if (T == 1 || params.storage != Storage::f32 || activity) return NaiveBackend::advance_blocked(dt, T);
+        trace::Scope<"block"> scope{T};
+        reserve_scratch(1, T);
+        refresh_halos();
+        advance_tile(T, 0, params.Nx, scratch[0], make_coeffs(dt));
+        swap_buffers();
     }
 };
 
-struct AVX256Backend : public NaiveBackend 
+// Runs the row kernel of Kernel on a persistent pool, one row band per worker.
+// The pool is created in initialize and reused for every step, and by later
+// initializes that ask for as many threads.
+template <typename Kernel>
+struct ThreadedBackend : public Kernel
 {
+    using Kernel::Kernel;
+
+    // shared with the allocator of the fields, which can outlive the backend
+    std::shared_ptr<parallel::ThreadPool> pool;
+
+    bool initialize(const Params& params) override
+    {
+        const unsigned n_threads = parallel::ThreadPool::size_for(params.threads.value_or(0));
+        if (!pool || pool->size() != n_threads) pool = std::make_shared<parallel::ThreadPool>(n_threads);
+        return Kernel::initialize(params);
+    }
+
+    void parallel_for(size_t n, const std::function<void(size_t, size_t)>& body) override
+    {
+        pool->parallel_for(0, n, body);
+    }
+
+    // The fields' pages are first touched by the worker that steps their rows.
+    // Copies of the fields share the allocator, and with it the pool.
+    std::shared_ptr<const matrix::Allocator> field_allocator(const Params& params) override
+    {
+        auto pool = this->pool;
+        return std::make_shared<matrix::Allocator>(matrix::Allocator{
+            .pages = params.pages,
+            .first_touch = [pool](size_t n, const std::function<void(size_t, size_t)>& body) {
+                pool->parallel_for(0, n, body);
+            }});
+    }
+
     void gray_scott_step(float dt) override
     {
+        trace::Scope<"step"> scope;
+        this->refresh_halos();
+        pool->parallel_for(0, this->params.Nx, [&](size_t row_begin, size_t row_end) {
+            trace::Scope<"band"> band{uint32_t(row_begin)};
+            this->step_rows(dt, row_begin, row_end);
+        });
+        this->swap_buffers();
+    }
+
+    void copy_to_output(void* output, OutputFormat format, size_t pitch) override
+    {
+        const auto out = this->make_target(output, format, pitch);
+        pool->parallel_for(0, this->params.Nx, [&](size_t row_begin, size_t row_end) {
+            this->copy_rows_to_output(row_begin, row_end, out);
+        });
+    }
+
+    void gray_scott_step_to_output(float dt, void* output, OutputFormat format, size_t pitch) override
+    {
+        const auto out = this->make_target(output, format, pitch);
+        trace::Scope<"step"> scope;
+        this->refresh_halos();
+        pool->parallel_for(0, this->params.Nx, [&](size_t row_begin, size_t row_end) {
+            trace::Scope<"band"> band{uint32_t(row_begin)};
+            this->step_rows_to_output(dt, row_begin, row_end, out);
+        });
+        this->swap_buffers();
+    }
+
+    // Bands of a temporally blocked pass are independent, each worker sweeps
+    // its own band with its own scratch.
+    void advance_blocked(float dt, unsigned T) override
+    {
+        if constexpr (requires { &Kernel::advance_tile; }) {
+            if (T == 1 || this->params.storage != Storage::f32 || this->activity)
+                return NaiveBackend::advance_blocked(dt, T);
+            this->reserve_scratch(pool->size(), T);
+            this->refresh_halos();
+            const auto c = this->make_coeffs(dt);
+            trace::Scope<"block"> scope{T};
+            pool->run([&](unsigned worker) {
+                auto [b, e] = parallel::ThreadPool::band(0, this->params.Nx, worker, pool->size());
+                trace::Scope<"band"> band{uint32_t(b)};
+                if (b < e) this->advance_tile(T, b, e, this->scratch[worker], c);
+            });
+            this->swap_buffers();
+        } else {
+            Kernel::advance_blocked(dt, T);
+        }
+    }
+};
+
+// Steps one subdomain of a SharedDomain with Base, any of the backends above,
+// on a grid that is just the subdomain: its ghost ring is filled from the
+// neighbours' published edges instead of wrapping around, and its edges are
+// published after every step. All subdomains step in lockstep, each waiting
+// for its neighbours' previous step before the next. Temporal blocking and
+// the activity mask assume the grid wraps onto itself and are off; fields
+// are fp32 only, and checkpoints of a subdomain cannot be restored. A
+// subdomain is initialized once: its neighbours have already seen the edges
+// of its earlier steps, and the domain's counters cannot go back.
+template <typename Base>
+struct SubdomainBackend : public Base
+{
+    template <typename... Args>
+    SubdomainBackend(std::shared_ptr<SharedDomain> domain, unsigned index, Args&&... args)
+        : Base(std::forward<Args>(args)...), domain(std::move(domain)), index(index) {}
+
+    std::shared_ptr<SharedDomain> domain;
+    unsigned index;
+    uint64_t step = 0; // steps since initialize, the version of the published edges
+    bool initialized = false;
+
+    // params describe the whole grid, which must be the domain's; false on
+    // a second call
+    bool initialize(const Params& params) override
+    {
+        if (initialized) return false;
+        if (params.Nx != domain->Nx() || params.Ny != domain->Ny() || params.storage != Storage::f32) return false;
+        const Subdomain s = domain->subdomain(index);
+        this->window = NaiveBackend::Window{s.row0, s.col0, params.Nx, params.Ny};
+        Params local = params;
+        local.Nx = s.Nx;
+        local.Ny = s.Ny;
+        local.time_block.reset();
+        local.activity_threshold.reset();
+        if (!Base::initialize(local)) return false;
+        initialized = true;
+        step = 0;
+        domain->publish(index, step, this->U.front, this->V.front);
+        return true;
+    }
+
+    bool restore_checkpoint(const std::string&, uint64_t*) override { return false; }
+
+    void refresh_halos() override
+    {
+        trace::Scope<"halo"> scope;
+        domain->receive(index, step, this->U.front, this->V.front);
     }
-    void copy_to_output(void* output, int format) override
+
+    void swap_buffers() override
     {
-        // Implement the copy to output functionality
+        Base::swap_buffers();
+        domain->publish(index, ++step, this->U.front, this->V.front);
     }
 };
 
-std::unique_ptr<Backend> Backend::create(const std::string& type)
+void render_frame(const FieldView& field, const Colormap& colormap, void* output, OutputFormat format, size_t pitch)
+{
+    const auto bgra = colormap.bgra_lut();
+    const uint32_t* lut = format == OutputFormat::BGRA8 ? bgra.data() : colormap.lut.data();
+    if (pitch == 0) pitch = field.cols * NaiveBackend::OutputTarget::bytes_per_pixel(format);
+    const NaiveBackend::OutputTarget out{static_cast<uint8_t*>(output), format, pitch};
+    kernels::best().render_rows(field.storage, field.U, field.V, field.pitch, field.cols, 0, field.rows,
+                                KernelBackend::render_target(colormap, lut, out));
+}
+
+template <typename B>
+using Unwrapped = B;
+
+// The backend named type as Wrap<backend>, constructed from args (and the
+// kernel table of kernel backends)
+template <template <typename> class Wrap, typename... Args>
+std::unique_ptr<Backend> create_backend(const std::string& type, Args&... args)
 {
     if (type == "naive") {
-        return std::make_unique<NaiveBackend>();
+        return std::make_unique<Wrap<NaiveBackend>>(args...);
+    }
+    else if (type == "threaded-naive") {
+        return std::make_unique<Wrap<ThreadedBackend<NaiveBackend>>>(args...);
     }
-    else if (type == "avx256") {
-        return std::make_unique<AVX256Backend>();
+    // "auto", "avx2", ... and "threaded" (auto), "threaded-avx2", ...
+    if (const auto [k, threaded] = kernels::parse_backend_type(type); k) {
+        if (threaded) return std::make_unique<Wrap<ThreadedBackend<KernelBackend>>>(args..., *k);
+        return std::make_unique<Wrap<KernelBackend>>(args..., *k);
     }
     //else if (type == "cuda") {
     //    return new GrayScottBackendCUDA();
@@ -128,4 +930,15 @@ std::unique_ptr<Backend> Backend::create(const std::string& type)
     return nullptr;
 }
 
+std::unique_ptr<Backend> Backend::create(const std::string& type)
+{
+    return create_backend<Unwrapped>(type);
+}
+
+std::unique_ptr<Backend> Backend::create(const std::string& type, std::shared_ptr<SharedDomain> domain, unsigned index)
+{
+    if (!domain || index >= domain->size()) return nullptr;
+    return create_backend<SubdomainBackend>(type, domain, index);
+}
+
 } // namespace GrayScott
@@ -0,0 +1,455 @@
+// AVX2 + FMA + F16C kernels, 8 cells per vector.
+#include <kernels.hpp>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#include <type_traits>
+#include "kernels_common.inl"
+
+namespace GrayScott::kernels {
+namespace {
+
+// Loads/stores 8 cells of a field as fp32. The 16-bit formats are widened
+// in registers, so only half the bytes per cell go through memory.
+struct F32Codec {
+    using T = float;
+    static inline __m256 load(const T* p) { return _mm256_loadu_ps(p); }
+    static inline __m256 load_aligned(const T* p) { return _mm256_load_ps(p); }
+    static inline void store_aligned(T* p, __m256 x) { _mm256_store_ps(p, x); }
+};
+
+struct F16Codec {
+    using T = uint16_t;
+    static inline __m256 load(const T* p) { return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+    static inline __m256 load_aligned(const T* p) { return _mm256_cvtph_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(p))); }
+    static inline void store_aligned(T* p, __m256 x) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(p), _mm256_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT));
+    }
+};
+
+struct BF16Codec {
+    using T = uint16_t;
+    static inline __m256 widen(__m128i h) {
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+    }
+    static inline __m256 load(const T* p) { return widen(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+    static inline __m256 load_aligned(const T* p) { return widen(_mm_load_si128(reinterpret_cast<const __m128i*>(p))); }
+    static inline void store_aligned(T* p, __m256 x) {
+        // round to nearest even, then pack the upper halves of the 8 lanes
+        __m256i bits = _mm256_castps_si256(x);
+        const __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+        bits = _mm256_srli_epi32(_mm256_add_epi32(bits, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7FFF))), 16);
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(bits, bits), 0xD8);
+        _mm_store_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(packed));
+    }
+};
+
+struct Coeffs {
+    __m256 k[9];
+    __m256 Du, Dv, F, Fk, dt, one;
+};
+
+Coeffs make_coeffs(const StepCoeffs& s)
+{
+    Coeffs c;
+    for (int i = 0; i < 9; ++i) c.k[i] = _mm256_set1_ps(s.lap[i]);
+    c.Du  = _mm256_set1_ps(s.Du);
+    c.Dv  = _mm256_set1_ps(s.Dv);
+    c.F   = _mm256_set1_ps(s.F);
+    c.Fk  = _mm256_set1_ps(s.F + s.k);
+    c.dt  = _mm256_set1_ps(s.dt);
+    c.one = _mm256_set1_ps(1.0f);
+    return c;
+}
+
+template <typename Codec, typename Stencil, typename T = typename Codec::T>
+inline __m256 laplacian8(const T* r0, const T* r1, const T* r2, const Coeffs& c)
+{
+    if constexpr (is_fixed_stencil<Stencil>) {
+        // The up + down pair sums of the three columns give both the edge
+        // sum (middle column, plus left and right) and the corner sum (outer
+        // columns), then one multiply and two FMAs with constant weights.
+        constexpr SymmetricStencil S = Stencil::weights;
+        const __m256 pair_l = _mm256_add_ps(Codec::load(r0 - 1), Codec::load(r2 - 1));
+        const __m256 pair_c = _mm256_add_ps(Codec::load_aligned(r0), Codec::load_aligned(r2));
+        const __m256 pair_r = _mm256_add_ps(Codec::load(r0 + 1), Codec::load(r2 + 1));
+        const __m256 edges = _mm256_add_ps(pair_c, _mm256_add_ps(Codec::load(r1 - 1), Codec::load(r1 + 1)));
+        const __m256 corners = _mm256_add_ps(pair_l, pair_r);
+        __m256 acc = _mm256_mul_ps(Codec::load_aligned(r1), _mm256_set1_ps(S.center));
+        acc = _mm256_fmadd_ps(edges, _mm256_set1_ps(S.edge), acc);
+        return _mm256_fmadd_ps(corners, _mm256_set1_ps(S.corner), acc);
+    } else {
+        __m256 acc = _mm256_mul_ps(Codec::load(r0 - 1), c.k[0]);
+        acc = _mm256_fmadd_ps(Codec::load_aligned(r0), c.k[1], acc);
+        acc = _mm256_fmadd_ps(Codec::load(r0 + 1), c.k[2], acc);
+        acc = _mm256_fmadd_ps(Codec::load(r1 - 1), c.k[3], acc);
+        acc = _mm256_fmadd_ps(Codec::load_aligned(r1), c.k[4], acc);
+        acc = _mm256_fmadd_ps(Codec::load(r1 + 1), c.k[5], acc);
+        acc = _mm256_fmadd_ps(Codec::load(r2 - 1), c.k[6], acc);
+        acc = _mm256_fmadd_ps(Codec::load_aligned(r2), c.k[7], acc);
+        return _mm256_fmadd_ps(Codec::load(r2 + 1), c.k[8], acc);
+    }
+}
+
+// Colormap in registers. The index math matches color_index: scale,
+// clamp to [0, 255], truncate.
+struct RenderCoeffs {
+    __m256 lo, scale, zero, top;
+    const uint32_t* lut;
+    OutputFormat format;
+    bool difference;
+};
+
+RenderCoeffs make_render_coeffs(const RenderTarget& out)
+{
+    return {
+        _mm256_set1_ps(out.lo),
+        _mm256_set1_ps(out.scale),
+        _mm256_setzero_ps(),
+        _mm256_set1_ps(255.0f),
+        out.lut,
+        out.format,
+        out.difference,
+    };
+}
+
+// Writes pixels x .. x+7 of an output row, clipped to width: the caller's
+// framebuffer has no padding, so the last vector of a row is stored masked.
+inline void render8(uint8_t* dst, int x, int width, __m256 u, __m256 v, const RenderCoeffs& r)
+{
+    const __m256 s = r.difference ? _mm256_sub_ps(u, v) : v;
+    __m256 t = _mm256_mul_ps(_mm256_sub_ps(s, r.lo), r.scale);
+    t = _mm256_min_ps(_mm256_max_ps(t, r.zero), r.top);
+    const __m256i idx = _mm256_cvttps_epi32(t);
+    const int n = min_of(width - x, 8);
+
+    if (r.format == OutputFormat::Gray8) {
+        __m256i b = _mm256_packus_epi32(idx, idx);
+        b = _mm256_packus_epi16(b, b);
+        b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(0, 4, 0, 4, 0, 4, 0, 4));
+        if (n == 8) {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm256_castsi256_si128(b));
+        } else {
+            alignas(16) uint8_t tail[16];
+            _mm_store_si128(reinterpret_cast<__m128i*>(tail), _mm256_castsi256_si128(b));
+            memcpy(dst + x, tail, n);
+        }
+        return;
+    }
+    const __m256i rgba = _mm256_i32gather_epi32(reinterpret_cast<const int*>(r.lut), idx, 4);
+    int* p = reinterpret_cast<int*>(dst + 4 * x);
+    if (n == 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), rgba);
+    } else {
+        const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        _mm256_maskstore_epi32(p, mask, rgba);
+    }
+}
+
+// Receives the new U and V of every vector fused_row produces.
+struct NoSink {
+    void operator()(int, __m256, __m256) const {}
+};
+
+struct PixelSink {
+    const RenderCoeffs& r;
+    uint8_t* row;
+    int width;
+    void operator()(int x, __m256 u, __m256 v) const { render8(row, x, width, u, v, r); }
+};
+
+// Raises change[i] to the largest |un - u|, |vn - v| of columns
+// [i, i + 1) * change_cols of a row just stepped, as in the AVX-512 kernels.
+// Lanes past the end of the row are masked off.
+void row_change(const float* u, const float* v, const float* un, const float* vn, int width, float* change)
+{
+    const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    for (int x0 = 0; x0 < width; x0 += change_cols) {
+        const int x1 = min_of(x0 + change_cols, width);
+        __m256 acc = _mm256_setzero_ps();
+        for (int x = x0; x < x1; x += 8) {
+            const __m256 du = _mm256_and_ps(_mm256_sub_ps(_mm256_load_ps(un + x), _mm256_load_ps(u + x)), abs_mask);
+            const __m256 dv = _mm256_and_ps(_mm256_sub_ps(_mm256_load_ps(vn + x), _mm256_load_ps(v + x)), abs_mask);
+            const __m256 in_row = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(x1 - x), lane));
+            acc = _mm256_max_ps(acc, _mm256_and_ps(_mm256_max_ps(du, dv), in_row));
+        }
+        __m128 h = _mm_max_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        h = _mm_max_ps(h, _mm_movehl_ps(h, h));
+        h = _mm_max_ss(h, _mm_shuffle_ps(h, h, 1));
+        float& c = change[x0 / change_cols];
+        c = max_of(c, _mm_cvtss_f32(h));
+    }
+}
+
+// Rows start 32-byte aligned and are readable up to a whole vector.
+template <typename Codec, typename T = typename Codec::T>
+void render_rows_with(const T* u, const T* v, std::ptrdiff_t stride, int width,
+                      int row_begin, int row_end, const RenderTarget& out)
+{
+    const RenderCoeffs r = make_render_coeffs(out);
+    for (int y = row_begin; y < row_end; ++y) {
+        const T* ur = u + y * stride;
+        const T* vr = v + y * stride;
+        for (int x = 0; x < width; x += 8)
+            render8(out.data + y * out.pitch, x, width, Codec::load_aligned(ur + x), Codec::load_aligned(vr + x), r);
+    }
+}
+
+// One output row of the fused step: both Laplacians are computed from the
+// three input rows around it and fed straight into the reaction update, so
+// no Laplacian temporaries are touched. The padding of the rows lets the
+// last vector run past the end of the row, so there is no tail loop.
+// sink receives the new values of every vector (the fused render path).
+template <typename Codec, typename Stencil, typename Sink = NoSink, typename T = typename Codec::T>
+void fused_row(const T* const u[3], const T* const v[3],
+               T* un, T* vn, int width, const Coeffs& c, const Sink& sink = {})
+{
+    for (int x = 0; x < width; x += 8) {
+        const __m256 lu = laplacian8<Codec, Stencil>(u[0] + x, u[1] + x, u[2] + x, c);
+        const __m256 lv = laplacian8<Codec, Stencil>(v[0] + x, v[1] + x, v[2] + x, c);
+        const __m256 uc = Codec::load_aligned(u[1] + x);
+        const __m256 vc = Codec::load_aligned(v[1] + x);
+        const __m256 uvv = _mm256_mul_ps(uc, _mm256_mul_ps(vc, vc));
+
+        // du = Du*lu - uvv + F*(1-u),  dv = Dv*lv + uvv - (F+k)*v
+        __m256 du = _mm256_fmsub_ps(c.Du, lu, uvv);
+        du = _mm256_fmadd_ps(c.F, _mm256_sub_ps(c.one, uc), du);
+        __m256 dv = _mm256_fmadd_ps(c.Dv, lv, uvv);
+        dv = _mm256_fnmadd_ps(c.Fk, vc, dv);
+
+        const __m256 u_out = _mm256_fmadd_ps(du, c.dt, uc);
+        const __m256 v_out = _mm256_fmadd_ps(dv, c.dt, vc);
+        Codec::store_aligned(un + x, u_out);
+        Codec::store_aligned(vn + x, v_out);
+        if constexpr (std::is_same_v<Codec, F32Codec>)
+            sink(x, u_out, v_out);
+        else // render what was stored, as render_rows would
+            sink(x, Codec::load_aligned(un + x), Codec::load_aligned(vn + x));
+    }
+}
+
+template <typename Codec, typename Stencil, typename T = typename Codec::T>
+void step_rows_with(const T* u, const T* v, T* un, T* vn, std::ptrdiff_t stride, int width,
+                    int row_begin, int row_end, const StepCoeffs& s, const RenderTarget* out)
+{
+    const Coeffs c = make_coeffs(s);
+    const RenderCoeffs r = out ? make_render_coeffs(*out) : RenderCoeffs{};
+    for (int y = row_begin; y < row_end; ++y) {
+        const std::ptrdiff_t o = y * stride;
+        const T* ur[3] = {u + o - stride, u + o, u + o + stride};
+        const T* vr[3] = {v + o - stride, v + o, v + o + stride};
+        // pixels are written from the registers of the step, un/vn are not read back
+        if (out)
+            fused_row<Codec, Stencil>(ur, vr, un + o, vn + o, width, c, PixelSink{r, out->data + y * out->pitch, width});
+        else
+            fused_row<Codec, Stencil>(ur, vr, un + o, vn + o, width, c);
+    }
+}
+
+// Instantiates f with the codec of a storage type.
+template <typename F>
+void with_codec(Storage storage, F&& f)
+{
+    switch (storage) {
+    case Storage::f32:  return f(F32Codec{});
+    case Storage::f16:  return f(F16Codec{});
+    case Storage::bf16: return f(BF16Codec{});
+    }
+}
+
+void step_rows(Storage storage, const void* u, const void* v, void* un, void* vn, std::ptrdiff_t stride,
+               int width, int row_begin, int row_end, const StepCoeffs& c, const RenderTarget* out)
+{
+    with_codec(storage, [&](auto codec) {
+        with_stencil(c, [&](auto stencil) {
+            using T = typename decltype(codec)::T;
+            step_rows_with<decltype(codec), decltype(stencil)>(static_cast<const T*>(u), static_cast<const T*>(v),
+                                                               static_cast<T*>(un), static_cast<T*>(vn), stride,
+                                                               width, row_begin, row_end, c, out);
+        });
+    });
+}
+
+void step_rows_tracked(const float* u, const float* v, float* un, float* vn, std::ptrdiff_t stride, int width,
+                       int row_begin, int row_end, const StepCoeffs& s, float* change)
+{
+    const Coeffs c = make_coeffs(s);
+    with_stencil(s, [&](auto stencil) {
+        for (int y = row_begin; y < row_end; ++y) {
+            const std::ptrdiff_t o = y * stride;
+            const float* ur[3] = {u + o - stride, u + o, u + o + stride};
+            const float* vr[3] = {v + o - stride, v + o, v + o + stride};
+            fused_row<F32Codec, decltype(stencil)>(ur, vr, un + o, vn + o, width, c);
+            row_change(u + o, v + o, un + o, vn + o, width, change);
+        }
+    });
+}
+
+void render_rows(Storage storage, const void* u, const void* v, std::ptrdiff_t stride, int width,
+                 int row_begin, int row_end, const RenderTarget& out)
+{
+    with_codec(storage, [&](auto codec) {
+        using T = typename decltype(codec)::T;
+        render_rows_with<decltype(codec)>(static_cast<const T*>(u), static_cast<const T*>(v), stride, width,
+                                          row_begin, row_end, out);
+    });
+}
+
+void advance_tile(const TileArgs& a, const StepCoeffs& s)
+{
+    const Coeffs c = make_coeffs(s);
+    with_stencil(s, [&](auto stencil) {
+        sweep_tile(a, [&](const float* const ur[3], const float* const vr[3], float* un, float* vn) {
+            fused_row<F32Codec, decltype(stencil)>(ur, vr, un, vn, a.width, c);
+        });
+    });
+}
+
+// Each cell is two vectors of members; the rows are swept once per half.
+// The up + down pair sums slide along the row, so every one of them serves
+// three output cells.
+void step_ensemble_rows(const EnsembleArgs& a, int row_begin, int row_end)
+{
+    constexpr int L = ensemble_lanes;
+    constexpr SymmetricStencil S = laplacian_stencil;
+    const __m256 center = _mm256_set1_ps(S.center), edge = _mm256_set1_ps(S.edge), corner = _mm256_set1_ps(S.corner);
+    const __m256 Du = _mm256_set1_ps(a.Du), Dv = _mm256_set1_ps(a.Dv), dt = _mm256_set1_ps(a.dt);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const int w = a.width;
+
+    for (int y = row_begin; y < row_end; ++y) {
+        for (int h = 0; h < L; h += 8) {
+            const __m256 F = _mm256_loadu_ps(a.F + h), Fk = _mm256_loadu_ps(a.Fk + h);
+            const float* u[3], * v[3];
+            for (int k = 0; k < 3; ++k) {
+                u[k] = ensemble_row(a.u, a, y - 1 + k) + h;
+                v[k] = ensemble_row(a.v, a, y - 1 + k) + h;
+            }
+            float* un = a.un + std::ptrdiff_t(y) * w * L + h;
+            float* vn = a.vn + std::ptrdiff_t(y) * w * L + h;
+            auto at = [](const float* row, int x) { return _mm256_load_ps(row + std::ptrdiff_t(x) * L); };
+            auto pair = [&](const float* const f[3], int x) { return _mm256_add_ps(at(f[0], x), at(f[2], x)); };
+            auto lap = [&](const float* const f[3], __m256 pl, __m256 pc, __m256 pr, int xl, int x, int xr) {
+                const __m256 edges = _mm256_add_ps(pc, _mm256_add_ps(at(f[1], xl), at(f[1], xr)));
+                const __m256 corners = _mm256_add_ps(pl, pr);
+                __m256 acc = _mm256_mul_ps(at(f[1], x), center);
+                acc = _mm256_fmadd_ps(edges, edge, acc);
+                return _mm256_fmadd_ps(corners, corner, acc);
+            };
+
+            __m256 pul = pair(u, w - 1), puc = pair(u, 0);
+            __m256 pvl = pair(v, w - 1), pvc = pair(v, 0);
+            for (int x = 0; x < w; ++x) {
+                const int xl = x == 0 ? w - 1 : x - 1, xr = x + 1 == w ? 0 : x + 1;
+                const __m256 pur = pair(u, xr), pvr = pair(v, xr);
+                const __m256 lu = lap(u, pul, puc, pur, xl, x, xr);
+                const __m256 lv = lap(v, pvl, pvc, pvr, xl, x, xr);
+                const __m256 uc = at(u[1], x);
+                const __m256 vc = at(v[1], x);
+                const __m256 uvv = _mm256_mul_ps(uc, _mm256_mul_ps(vc, vc));
+
+                __m256 du = _mm256_fmsub_ps(Du, lu, uvv);
+                du = _mm256_fmadd_ps(F, _mm256_sub_ps(one, uc), du);
+                __m256 dv = _mm256_fmadd_ps(Dv, lv, uvv);
+                dv = _mm256_fnmadd_ps(Fk, vc, dv);
+                _mm256_store_ps(un + std::ptrdiff_t(x) * L, _mm256_fmadd_ps(du, dt, uc));
+                _mm256_store_ps(vn + std::ptrdiff_t(x) * L, _mm256_fmadd_ps(dv, dt, vc));
+
+                pul = puc, puc = pur;
+                pvl = pvc, pvc = pvr;
+            }
+        }
+    }
+}
+
+void narrow(Storage storage, const float* src, uint16_t* dst, size_t n)
+{
+    if (storage == Storage::f16)
+        transform_n(src, n, dst, [](float x) { return uint16_t(_cvtss_sh(x, _MM_FROUND_TO_NEAREST_INT)); });
+    else
+        transform_n(src, n, dst, bf16_from_float);
+}
+
+void widen(Storage storage, const uint16_t* src, float* dst, size_t n)
+{
+    if (storage == Storage::f16)
+        transform_n(src, n, dst, [](uint16_t x) { return _cvtsh_ss(x); });
+    else
+        transform_n(src, n, dst, bf16_to_float);
+}
+
+template <int k>
+inline __m256i rotl64(__m256i x)
+{
+    return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+// The rng_lanes generators as two vectors of four lanes
+struct Xoshiro4x2 {
+    __m256i s[4][2];
+
+    explicit Xoshiro4x2(const RngLanes& rng)
+    {
+        for (int w = 0; w < 4; ++w)
+            for (int h = 0; h < 2; ++h) s[w][h] = _mm256_load_si256(reinterpret_cast<const __m256i*>(rng.s[w] + 4 * h));
+    }
+
+    void save(RngLanes& rng) const
+    {
+        for (int w = 0; w < 4; ++w)
+            for (int h = 0; h < 2; ++h) _mm256_store_si256(reinterpret_cast<__m256i*>(rng.s[w] + 4 * h), s[w][h]);
+    }
+
+    // The draws of lanes 4h .. 4h + 3
+    __m256i next(int h)
+    {
+        const __m256i r = _mm256_add_epi64(rotl64<23>(_mm256_add_epi64(s[0][h], s[3][h])), s[0][h]);
+        const __m256i t = _mm256_slli_epi64(s[1][h], 17);
+        s[2][h] = _mm256_xor_si256(s[2][h], s[0][h]);
+        s[3][h] = _mm256_xor_si256(s[3][h], s[1][h]);
+        s[1][h] = _mm256_xor_si256(s[1][h], s[2][h]);
+        s[0][h] = _mm256_xor_si256(s[0][h], s[3][h]);
+        s[2][h] = _mm256_xor_si256(s[2][h], t);
+        s[3][h] = rotl64<45>(s[3][h]);
+        return r;
+    }
+};
+
+void uniform(RngLanes& rng, float* out, size_t n)
+{
+    Xoshiro4x2 x(rng);
+    const __m256 scale = _mm256_set1_ps(0x1p-24f);
+    for (size_t i = 0; i < n; i += 2 * rng_lanes) {
+        for (int h = 0; h < 2; ++h)
+            _mm256_storeu_ps(out + i + 8 * h, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x.next(h), 8)), scale));
+    }
+    x.save(rng);
+}
+
+void normal(RngLanes& rng, float* out, size_t n)
+{
+    Xoshiro4x2 x(rng);
+    for (size_t i = 0; i < n; i += 2 * rng_lanes) {
+        const __m256 r0 = _mm256_castsi256_ps(x.next(0));
+        const __m256 r1 = _mm256_castsi256_ps(x.next(1));
+        // low and high halves of the eight draws, back in lane order
+        auto gather = [](__m256 halves) {
+            return _mm256_srli_epi32(_mm256_permute4x64_epi64(_mm256_castps_si256(halves), _MM_SHUFFLE(3, 1, 2, 0)), 8);
+        };
+        const __m256i k1 = gather(_mm256_shuffle_ps(r0, r1, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m256i k2 = gather(_mm256_shuffle_ps(r0, r1, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256 z0, z1;
+        box_muller(k1, k2, z0, z1);
+        _mm256_storeu_ps(out + i, z0);
+        _mm256_storeu_ps(out + i + rng_lanes, z1);
+    }
+    x.save(rng);
+}
+
+} // namespace
+
+const Kernels avx2_kernels{Isa::avx2, "avx2", step_rows, render_rows, advance_tile, narrow, widen,
+                           step_ensemble_rows, step_rows_tracked, uniform, normal};
+
+} // namespace GrayScott::kernels
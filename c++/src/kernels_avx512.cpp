@@ -0,0 +1,538 @@
+// AVX-512 (F/VL/BW/DQ) kernels, 16 cells per vector. Row tails are handled
+// with masked loads and stores, and the x-1 / x+1 neighbours of a vector are
+// shifted in from the vectors on either side with valignd, so every row is
+// loaded once per step instead of three times.
+#include <kernels.hpp>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+#include <type_traits>
+#include "kernels_common.inl"
+
+namespace GrayScott::kernels {
+namespace {
+
+// the first n lanes, n clamped to [0, 16]
+inline __mmask16 lanes(int n)
+{
+    return n >= 16 ? __mmask16(0xFFFF) : n <= 0 ? __mmask16(0) : __mmask16((1u << n) - 1);
+}
+
+// Loads/stores 16 cells of a field as fp32, masked lanes read as zero and are
+// not touched in memory.
+struct F32Codec {
+    using T = float;
+    static inline __m512 load(const T* p, __mmask16 m) { return _mm512_maskz_loadu_ps(m, p); }
+    static inline void store(T* p, __mmask16 m, __m512 x) { _mm512_mask_storeu_ps(p, m, x); }
+};
+
+struct F16Codec {
+    using T = uint16_t;
+    static inline __m512 load(const T* p, __mmask16 m) { return _mm512_cvtph_ps(_mm256_maskz_loadu_epi16(m, p)); }
+    static inline void store(T* p, __mmask16 m, __m512 x) {
+        _mm256_mask_storeu_epi16(p, m, _mm512_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT));
+    }
+};
+
+struct BF16Codec {
+    using T = uint16_t;
+    static inline __m512 load(const T* p, __mmask16 m) {
+        return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(m, p)), 16));
+    }
+    static inline void store(T* p, __mmask16 m, __m512 x) {
+        // round to nearest even, then keep the upper halves
+        __m512i bits = _mm512_castps_si512(x);
+        const __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1));
+        bits = _mm512_srli_epi32(_mm512_add_epi32(bits, _mm512_add_epi32(lsb, _mm512_set1_epi32(0x7FFF))), 16);
+        _mm256_mask_storeu_epi16(p, m, _mm512_cvtepi32_epi16(bits));
+    }
+};
+
+struct Coeffs {
+    __m512 k[9];
+    __m512 Du, Dv, F, Fk, dt, one;
+};
+
+Coeffs make_coeffs(const StepCoeffs& s)
+{
+    Coeffs c;
+    for (int i = 0; i < 9; ++i) c.k[i] = _mm512_set1_ps(s.lap[i]);
+    c.Du  = _mm512_set1_ps(s.Du);
+    c.Dv  = _mm512_set1_ps(s.Dv);
+    c.F   = _mm512_set1_ps(s.F);
+    c.Fk  = _mm512_set1_ps(s.F + s.k);
+    c.dt  = _mm512_set1_ps(s.dt);
+    c.one = _mm512_set1_ps(1.0f);
+    return c;
+}
+
+// Cells x-1 .. x+16 of a row held as three vectors: the last lane of prev,
+// cur, and the first lane of next.
+struct Window {
+    __m512 prev, cur, next;
+    __m512 left() const { return _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(cur), _mm512_castps_si512(prev), 15)); }
+    __m512 right() const { return _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(next), _mm512_castps_si512(cur), 1)); }
+};
+
+// Sliding windows over the three rows around an output row. Cells are
+// read up to and including column width (the right ghost cell), never
+// beyond, and column -1 only through the first prev. For a fixed stencil
+// the window also carries the up + down pair sums, each computed once and
+// shared by the three output vectors that see it.
+template <typename Codec, typename Stencil, typename T = typename Codec::T>
+struct Rows {
+    static constexpr bool fixed = is_fixed_stencil<Stencil>;
+    const T* const* r;
+    int width;
+    Window w[3];
+    Window pairs;
+
+    Rows(const T* const rows[3], int width) : r(rows), width(width)
+    {
+        for (int k = 0; k < 3; ++k)
+            w[k] = {Codec::load(r[k] - 16, 0x8000), Codec::load(r[k], lanes(width + 1)),
+                    Codec::load(r[k] + 16, lanes(width + 1 - 16))};
+        if constexpr (fixed)
+            pairs = {_mm512_add_ps(w[0].prev, w[2].prev), _mm512_add_ps(w[0].cur, w[2].cur),
+                     _mm512_add_ps(w[0].next, w[2].next)};
+    }
+
+    void advance(int x)
+    {
+        for (int k = 0; k < 3; ++k)
+            w[k] = {w[k].cur, w[k].next, Codec::load(r[k] + x + 32, lanes(width + 1 - x - 32))};
+        if constexpr (fixed)
+            pairs = {pairs.cur, pairs.next, _mm512_add_ps(w[0].next, w[2].next)};
+    }
+
+    __m512 laplacian(const Coeffs& c) const
+    {
+        if constexpr (fixed) {
+            constexpr SymmetricStencil S = Stencil::weights;
+            const __m512 edges = _mm512_add_ps(pairs.cur, _mm512_add_ps(w[1].left(), w[1].right()));
+            const __m512 corners = _mm512_add_ps(pairs.left(), pairs.right());
+            __m512 acc = _mm512_mul_ps(w[1].cur, _mm512_set1_ps(S.center));
+            acc = _mm512_fmadd_ps(edges, _mm512_set1_ps(S.edge), acc);
+            return _mm512_fmadd_ps(corners, _mm512_set1_ps(S.corner), acc);
+        } else {
+            // in the order of the AVX2 kernels; without -ffast-math the two
+            // give bit-identical results
+            __m512 acc = _mm512_mul_ps(w[0].left(), c.k[0]);
+            acc = _mm512_fmadd_ps(w[0].cur, c.k[1], acc);
+            acc = _mm512_fmadd_ps(w[0].right(), c.k[2], acc);
+            acc = _mm512_fmadd_ps(w[1].left(), c.k[3], acc);
+            acc = _mm512_fmadd_ps(w[1].cur, c.k[4], acc);
+            acc = _mm512_fmadd_ps(w[1].right(), c.k[5], acc);
+            acc = _mm512_fmadd_ps(w[2].left(), c.k[6], acc);
+            acc = _mm512_fmadd_ps(w[2].cur, c.k[7], acc);
+            return _mm512_fmadd_ps(w[2].right(), c.k[8], acc);
+        }
+    }
+};
+
+// Colormap in registers. The index math matches color_index: scale,
+// clamp to [0, 255], truncate.
+struct RenderCoeffs {
+    __m512 lo, scale, zero, top;
+    const uint32_t* lut;
+    OutputFormat format;
+    bool difference;
+};
+
+RenderCoeffs make_render_coeffs(const RenderTarget& out)
+{
+    return {
+        _mm512_set1_ps(out.lo),
+        _mm512_set1_ps(out.scale),
+        _mm512_setzero_ps(),
+        _mm512_set1_ps(255.0f),
+        out.lut,
+        out.format,
+        out.difference,
+    };
+}
+
+// Writes pixels x .. x+15 of an output row, the lanes of m only.
+inline void render16(uint8_t* dst, int x, __mmask16 m, __m512 u, __m512 v, const RenderCoeffs& r)
+{
+    const __m512 s = r.difference ? _mm512_sub_ps(u, v) : v;
+    __m512 t = _mm512_mul_ps(_mm512_sub_ps(s, r.lo), r.scale);
+    t = _mm512_min_ps(_mm512_max_ps(t, r.zero), r.top);
+    const __m512i idx = _mm512_cvttps_epi32(t);
+
+    if (r.format == OutputFormat::Gray8) {
+        _mm_mask_storeu_epi8(dst + x, m, _mm512_cvtepi32_epi8(idx));
+        return;
+    }
+    const __m512i rgba = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m, idx, r.lut, 4);
+    _mm512_mask_storeu_epi32(dst + 4 * x, m, rgba);
+}
+
+// Receives the new U and V of every vector fused_row produces.
+struct NoSink {
+    void operator()(int, __mmask16, __m512, __m512) const {}
+};
+
+struct PixelSink {
+    const RenderCoeffs& r;
+    uint8_t* row;
+    void operator()(int x, __mmask16 m, __m512 u, __m512 v) const { render16(row, x, m, u, v, r); }
+};
+
+// Raises change[i] to the largest |un - u|, |vn - v| of columns
+// [i, i + 1) * change_cols of a row. A pass of its own over the row just
+// stepped, still in L1: in the loop of fused_row, fast-math would refold the
+// step around the difference and round it differently from step_rows.
+void row_change(const float* u, const float* v, const float* un, const float* vn, int width, float* change)
+{
+    for (int x0 = 0; x0 < width; x0 += change_cols) {
+        const int x1 = min_of(x0 + change_cols, width);
+        __m512 acc = _mm512_setzero_ps();
+        for (int x = x0; x < x1; x += 16) {
+            const __mmask16 m = lanes(x1 - x);
+            const __m512 du = _mm512_abs_ps(_mm512_sub_ps(_mm512_maskz_load_ps(m, un + x), _mm512_maskz_load_ps(m, u + x)));
+            const __m512 dv = _mm512_abs_ps(_mm512_sub_ps(_mm512_maskz_load_ps(m, vn + x), _mm512_maskz_load_ps(m, v + x)));
+            acc = _mm512_max_ps(acc, _mm512_max_ps(du, dv));
+        }
+        float& c = change[x0 / change_cols];
+        c = max_of(c, _mm512_reduce_max_ps(acc));
+    }
+}
+
+template <typename Codec, typename T = typename Codec::T>
+void render_rows_with(const T* u, const T* v, std::ptrdiff_t stride, int width,
+                      int row_begin, int row_end, const RenderTarget& out)
+{
+    const RenderCoeffs r = make_render_coeffs(out);
+    for (int y = row_begin; y < row_end; ++y) {
+        const T* ur = u + y * stride;
+        const T* vr = v + y * stride;
+        for (int x = 0; x < width; x += 16) {
+            const __mmask16 m = lanes(width - x);
+            render16(out.data + y * out.pitch, x, m, Codec::load(ur + x, m), Codec::load(vr + x, m), r);
+        }
+    }
+}
+
+// One output row of the fused step, as in the AVX2 kernels. Only the cells
+// of the row are stored; its ghost cells and padding are left alone.
+template <typename Codec, typename Stencil, typename Sink = NoSink, typename T = typename Codec::T>
+void fused_row(const T* const u[3], const T* const v[3],
+               T* un, T* vn, int width, const Coeffs& c, const Sink& sink = {})
+{
+    Rows<Codec, Stencil> ru(u, width), rv(v, width);
+    for (int x = 0; x < width; x += 16) {
+        const __mmask16 m = lanes(width - x);
+        const __m512 lu = ru.laplacian(c);
+        const __m512 lv = rv.laplacian(c);
+        const __m512 uc = ru.w[1].cur;
+        const __m512 vc = rv.w[1].cur;
+        const __m512 uvv = _mm512_mul_ps(uc, _mm512_mul_ps(vc, vc));
+
+        // du = Du*lu - uvv + F*(1-u),  dv = Dv*lv + uvv - (F+k)*v
+        __m512 du = _mm512_fmsub_ps(c.Du, lu, uvv);
+        du = _mm512_fmadd_ps(c.F, _mm512_sub_ps(c.one, uc), du);
+        __m512 dv = _mm512_fmadd_ps(c.Dv, lv, uvv);
+        dv = _mm512_fnmadd_ps(c.Fk, vc, dv);
+
+        const __m512 u_out = _mm512_fmadd_ps(du, c.dt, uc);
+        const __m512 v_out = _mm512_fmadd_ps(dv, c.dt, vc);
+        Codec::store(un + x, m, u_out);
+        Codec::store(vn + x, m, v_out);
+        if constexpr (std::is_same_v<Codec, F32Codec>)
+            sink(x, m, u_out, v_out);
+        else // render what was stored, as render_rows would
+            sink(x, m, Codec::load(un + x, m), Codec::load(vn + x, m));
+
+        ru.advance(x);
+        rv.advance(x);
+    }
+}
+
+template <typename Codec, typename Stencil, typename T = typename Codec::T>
+void step_rows_with(const T* u, const T* v, T* un, T* vn, std::ptrdiff_t stride, int width,
+                    int row_begin, int row_end, const StepCoeffs& s, const RenderTarget* out)
+{
+    const Coeffs c = make_coeffs(s);
+    const RenderCoeffs r = out ? make_render_coeffs(*out) : RenderCoeffs{};
+    for (int y = row_begin; y < row_end; ++y) {
+        const std::ptrdiff_t o = y * stride;
+        const T* ur[3] = {u + o - stride, u + o, u + o + stride};
+        const T* vr[3] = {v + o - stride, v + o, v + o + stride};
+        if (out)
+            fused_row<Codec, Stencil>(ur, vr, un + o, vn + o, width, c, PixelSink{r, out->data + y * out->pitch});
+        else
+            fused_row<Codec, Stencil>(ur, vr, un + o, vn + o, width, c);
+    }
+}
+
+template <typename F>
+void with_codec(Storage storage, F&& f)
+{
+    switch (storage) {
+    case Storage::f32:  return f(F32Codec{});
+    case Storage::f16:  return f(F16Codec{});
+    case Storage::bf16: return f(BF16Codec{});
+    }
+}
+
+void step_rows(Storage storage, const void* u, const void* v, void* un, void* vn, std::ptrdiff_t stride,
+               int width, int row_begin, int row_end, const StepCoeffs& c, const RenderTarget* out)
+{
+    with_codec(storage, [&](auto codec) {
+        with_stencil(c, [&](auto stencil) {
+            using T = typename decltype(codec)::T;
+            step_rows_with<decltype(codec), decltype(stencil)>(static_cast<const T*>(u), static_cast<const T*>(v),
+                                                               static_cast<T*>(un), static_cast<T*>(vn), stride,
+                                                               width, row_begin, row_end, c, out);
+        });
+    });
+}
+
+void step_rows_tracked(const float* u, const float* v, float* un, float* vn, std::ptrdiff_t stride, int width,
+                       int row_begin, int row_end, const StepCoeffs& s, float* change)
+{
+    const Coeffs c = make_coeffs(s);
+    with_stencil(s, [&](auto stencil) {
+        for (int y = row_begin; y < row_end; ++y) {
+            const std::ptrdiff_t o = y * stride;
+            const float* ur[3] = {u + o - stride, u + o, u + o + stride};
+            const float* vr[3] = {v + o - stride, v + o, v + o + stride};
+            fused_row<F32Codec, decltype(stencil)>(ur, vr, un + o, vn + o, width, c);
+            row_change(u + o, v + o, un + o, vn + o, width, change);
+        }
+    });
+}
+
+void render_rows(Storage storage, const void* u, const void* v, std::ptrdiff_t stride, int width,
+                 int row_begin, int row_end, const RenderTarget& out)
+{
+    with_codec(storage, [&](auto codec) {
+        using T = typename decltype(codec)::T;
+        render_rows_with<decltype(codec)>(static_cast<const T*>(u), static_cast<const T*>(v), stride, width,
+                                          row_begin, row_end, out);
+    });
+}
+
+void advance_tile(const TileArgs& a, const StepCoeffs& s)
+{
+    const Coeffs c = make_coeffs(s);
+    with_stencil(s, [&](auto stencil) {
+        sweep_tile(a, [&](const float* const ur[3], const float* const vr[3], float* un, float* vn) {
+            fused_row<F32Codec, decltype(stencil)>(ur, vr, un, vn, a.width, c);
+        });
+    });
+}
+
+// One vector per cell, as in the AVX2 kernels but in a single sweep.
+void step_ensemble_rows(const EnsembleArgs& a, int row_begin, int row_end)
+{
+    constexpr int L = ensemble_lanes;
+    constexpr SymmetricStencil S = laplacian_stencil;
+    const __m512 center = _mm512_set1_ps(S.center), edge = _mm512_set1_ps(S.edge), corner = _mm512_set1_ps(S.corner);
+    const __m512 Du = _mm512_set1_ps(a.Du), Dv = _mm512_set1_ps(a.Dv), dt = _mm512_set1_ps(a.dt);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 F = _mm512_loadu_ps(a.F), Fk = _mm512_loadu_ps(a.Fk);
+    const int w = a.width;
+
+    for (int y = row_begin; y < row_end; ++y) {
+        const float* u[3], * v[3];
+        for (int k = 0; k < 3; ++k) {
+            u[k] = ensemble_row(a.u, a, y - 1 + k);
+            v[k] = ensemble_row(a.v, a, y - 1 + k);
+        }
+        float* un = a.un + std::ptrdiff_t(y) * w * L;
+        float* vn = a.vn + std::ptrdiff_t(y) * w * L;
+        auto at = [](const float* row, int x) { return _mm512_load_ps(row + std::ptrdiff_t(x) * L); };
+        auto pair = [&](const float* const f[3], int x) { return _mm512_add_ps(at(f[0], x), at(f[2], x)); };
+        auto lap = [&](const float* const f[3], __m512 pl, __m512 pc, __m512 pr, int xl, int x, int xr) {
+            const __m512 edges = _mm512_add_ps(pc, _mm512_add_ps(at(f[1], xl), at(f[1], xr)));
+            const __m512 corners = _mm512_add_ps(pl, pr);
+            __m512 acc = _mm512_mul_ps(at(f[1], x), center);
+            acc = _mm512_fmadd_ps(edges, edge, acc);
+            return _mm512_fmadd_ps(corners, corner, acc);
+        };
+
+        __m512 pul = pair(u, w - 1), puc = pair(u, 0);
+        __m512 pvl = pair(v, w - 1), pvc = pair(v, 0);
+        for (int x = 0; x < w; ++x) {
+            const int xl = x == 0 ? w - 1 : x - 1, xr = x + 1 == w ? 0 : x + 1;
+            const __m512 pur = pair(u, xr), pvr = pair(v, xr);
+            const __m512 lu = lap(u, pul, puc, pur, xl, x, xr);
+            const __m512 lv = lap(v, pvl, pvc, pvr, xl, x, xr);
+            const __m512 uc = at(u[1], x);
+            const __m512 vc = at(v[1], x);
+            const __m512 uvv = _mm512_mul_ps(uc, _mm512_mul_ps(vc, vc));
+
+            __m512 du = _mm512_fmsub_ps(Du, lu, uvv);
+            du = _mm512_fmadd_ps(F, _mm512_sub_ps(one, uc), du);
+            __m512 dv = _mm512_fmadd_ps(Dv, lv, uvv);
+            dv = _mm512_fnmadd_ps(Fk, vc, dv);
+            _mm512_store_ps(un + std::ptrdiff_t(x) * L, _mm512_fmadd_ps(du, dt, uc));
+            _mm512_store_ps(vn + std::ptrdiff_t(x) * L, _mm512_fmadd_ps(dv, dt, vc));
+
+            pul = puc, puc = pur;
+            pvl = pvc, pvc = pvr;
+        }
+    }
+}
+
+void narrow(Storage storage, const float* src, uint16_t* dst, size_t n)
+{
+    with_codec(storage, [&](auto codec) {
+        using Codec = decltype(codec);
+        if constexpr (!std::is_same_v<Codec, F32Codec>) {
+            for (size_t i = 0; i < n; i += 16) {
+                const __mmask16 m = lanes(int(min_of<size_t>(n - i, 16)));
+                Codec::store(dst + i, m, _mm512_maskz_loadu_ps(m, src + i));
+            }
+        }
+    });
+}
+
+void widen(Storage storage, const uint16_t* src, float* dst, size_t n)
+{
+    with_codec(storage, [&](auto codec) {
+        using Codec = decltype(codec);
+        if constexpr (!std::is_same_v<Codec, F32Codec>) {
+            for (size_t i = 0; i < n; i += 16) {
+                const __mmask16 m = lanes(int(min_of<size_t>(n - i, 16)));
+                _mm512_mask_storeu_ps(dst + i, m, Codec::load(src + i, m));
+            }
+        }
+    });
+}
+
+// The rng_lanes generators, one lane per 64-bit element
+struct Xoshiro8 {
+    __m512i s0, s1, s2, s3;
+
+    explicit Xoshiro8(const RngLanes& rng)
+        : s0(_mm512_load_si512(rng.s[0])), s1(_mm512_load_si512(rng.s[1])), s2(_mm512_load_si512(rng.s[2])),
+          s3(_mm512_load_si512(rng.s[3]))
+    {
+    }
+
+    void save(RngLanes& rng) const
+    {
+        _mm512_store_si512(rng.s[0], s0);
+        _mm512_store_si512(rng.s[1], s1);
+        _mm512_store_si512(rng.s[2], s2);
+        _mm512_store_si512(rng.s[3], s3);
+    }
+
+    __m512i next()
+    {
+        const __m512i r = _mm512_add_epi64(_mm512_rol_epi64(_mm512_add_epi64(s0, s3), 23), s0);
+        const __m512i t = _mm512_slli_epi64(s1, 17);
+        s2 = _mm512_xor_si512(s2, s0);
+        s3 = _mm512_xor_si512(s3, s1);
+        s1 = _mm512_xor_si512(s1, s2);
+        s0 = _mm512_xor_si512(s0, s3);
+        s2 = _mm512_xor_si512(s2, t);
+        s3 = _mm512_rol_epi64(s3, 45);
+        return r;
+    }
+};
+
+void uniform(RngLanes& rng, float* out, size_t n)
+{
+    Xoshiro8 x(rng);
+    const __m512 scale = _mm512_set1_ps(0x1p-24f);
+    for (size_t i = 0; i < n; i += 2 * rng_lanes)
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_srli_epi32(x.next(), 8)), scale));
+    x.save(rng);
+}
+
+// box_muller of kernels_common.inl, sixteen lanes wide
+inline __m512 log_unit(__m512 x)
+{
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512i bits = _mm512_castps_si512(x);
+    __m512 e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(126)));
+    const __m512 m = _mm512_castsi512_ps(
+        _mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007FFFFF)), _mm512_set1_epi32(0x3F000000)));
+    const __mmask16 low = _mm512_cmp_ps_mask(m, _mm512_set1_ps(0.70710678f), _CMP_LT_OQ);
+    e = _mm512_mask_sub_ps(e, low, e, one);
+    const __m512 f = _mm512_mask_add_ps(_mm512_sub_ps(m, one), low, _mm512_sub_ps(m, one), m);
+    const __m512 z = _mm512_mul_ps(f, f);
+    __m512 y = _mm512_set1_ps(7.0376836292e-2f);
+    for (float k : log_poly)
+        y = _mm512_fmadd_ps(y, f, _mm512_set1_ps(k));
+    y = _mm512_mul_ps(_mm512_mul_ps(y, f), z);
+    y = _mm512_fnmadd_ps(_mm512_set1_ps(2.12194440e-4f), e, y);
+    y = _mm512_fnmadd_ps(_mm512_set1_ps(0.5f), z, y);
+    return _mm512_fmadd_ps(_mm512_set1_ps(0.693359375f), e, _mm512_add_ps(f, y));
+}
+
+inline void sincos_2pi(__m512 t, __m512& s, __m512& c)
+{
+    const __m512i q = _mm512_cvttps_epi32(_mm512_fmadd_ps(t, _mm512_set1_ps(4.0f), _mm512_set1_ps(0.5f)));
+    const __m512 a = _mm512_mul_ps(_mm512_fnmadd_ps(_mm512_cvtepi32_ps(q), _mm512_set1_ps(0.25f), t),
+                                   _mm512_set1_ps(6.28318531f));
+    const __m512 z = _mm512_mul_ps(a, a);
+    __m512 ps = _mm512_fmadd_ps(_mm512_set1_ps(-1.9515295891e-4f), z, _mm512_set1_ps(8.3321608736e-3f));
+    ps = _mm512_fmadd_ps(ps, z, _mm512_set1_ps(-1.6666654611e-1f));
+    const __m512 sa = _mm512_fmadd_ps(_mm512_mul_ps(a, z), ps, a);
+    __m512 pc = _mm512_fmadd_ps(_mm512_set1_ps(2.443315711809948e-5f), z, _mm512_set1_ps(-1.388731625493765e-3f));
+    pc = _mm512_fmadd_ps(pc, z, _mm512_set1_ps(4.166664568298827e-2f));
+    const __m512 ca = _mm512_fmadd_ps(_mm512_mul_ps(z, z), pc, _mm512_fnmadd_ps(_mm512_set1_ps(0.5f), z, _mm512_set1_ps(1.0f)));
+    const __mmask16 swap = _mm512_test_epi32_mask(q, _mm512_set1_epi32(1));
+    const __m512 sv = _mm512_mask_blend_ps(swap, sa, ca);
+    const __m512 cv = _mm512_mask_blend_ps(swap, ca, sa);
+    // bit 1 of q, and of q + 1, moved to the sign bit
+    const __m512i two = _mm512_set1_epi32(2);
+    s = _mm512_xor_ps(sv, _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_and_si512(q, two), 30)));
+    c = _mm512_xor_ps(cv, _mm512_castsi512_ps(_mm512_slli_epi32(
+                              _mm512_and_si512(_mm512_add_epi32(q, _mm512_set1_epi32(1)), two), 30)));
+}
+
+inline void box_muller(__m512i k1, __m512i k2, __m512& z0, __m512& z1)
+{
+    const __m512 scale = _mm512_set1_ps(0x1p-24f);
+    const __m512 u = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_add_epi32(k1, _mm512_set1_epi32(1))), scale);
+    const __m512 r = _mm512_sqrt_ps(_mm512_mul_ps(_mm512_set1_ps(-2.0f), log_unit(u)));
+    __m512 s, c;
+    sincos_2pi(_mm512_mul_ps(_mm512_cvtepi32_ps(k2), scale), s, c);
+    z0 = _mm512_mul_ps(r, c);
+    z1 = _mm512_mul_ps(r, s);
+}
+
+// Two steps of the generators per sixteen wide Box-Muller
+void normal(RngLanes& rng, float* out, size_t n)
+{
+    Xoshiro8 x(rng);
+    const __m512i lows = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const __m512i highs = _mm512_add_epi32(lows, _mm512_set1_epi32(1));
+    // cos then sin of the first step, then of the second
+    const __m512i first = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 16, 17, 18, 19, 20, 21, 22, 23);
+    const __m512i second = _mm512_add_epi32(first, _mm512_set1_epi32(8));
+    size_t i = 0;
+    for (; i + 4 * rng_lanes <= n; i += 4 * rng_lanes) {
+        const __m512i a = x.next();
+        const __m512i b = x.next();
+        const __m512i k1 = _mm512_srli_epi32(_mm512_permutex2var_epi32(a, lows, b), 8);
+        const __m512i k2 = _mm512_srli_epi32(_mm512_permutex2var_epi32(a, highs, b), 8);
+        __m512 z0, z1;
+        box_muller(k1, k2, z0, z1);
+        _mm512_storeu_ps(out + i, _mm512_permutex2var_ps(z0, first, z1));
+        _mm512_storeu_ps(out + i + 2 * rng_lanes, _mm512_permutex2var_ps(z0, second, z1));
+    }
+    if (i < n) {
+        const __m512i r = x.next();
+        const __m256i k1 = _mm256_srli_epi32(_mm512_cvtepi64_epi32(r), 8);
+        const __m256i k2 = _mm512_cvtepi64_epi32(_mm512_srli_epi64(r, 40));
+        __m256 z0, z1;
+        box_muller(k1, k2, z0, z1);
+        _mm256_storeu_ps(out + i, z0);
+        _mm256_storeu_ps(out + i + rng_lanes, z1);
+    }
+    x.save(rng);
+}
+
+} // namespace
+
+const Kernels avx512_kernels{Isa::avx512, "avx512", step_rows, render_rows, advance_tile, narrow, widen,
+                             step_ensemble_rows, step_rows_tracked, uniform, normal};
+
+} // namespace GrayScott::kernels
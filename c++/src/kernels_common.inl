@@ -0,0 +1,297 @@
+// Helpers shared by every kernels_*.cpp. Each translation unit includes this
+// once and gets its own copy in an anonymous namespace, compiled for its ISA.
+
+namespace GrayScott::kernels {
+namespace {
+
+// Stand-ins for std::min, std::max, std::rotl, std::transform and the like.
+// A std template instantiated here is emitted (at -O0 as an out-of-line weak
+// symbol) with this translation unit's ISA flags, and the linker may keep
+// that copy for baseline callers too. These have internal linkage instead.
+template <typename T>
+inline T min_of(T a, T b) { return b < a ? b : a; }
+
+template <typename T>
+inline T max_of(T a, T b) { return a < b ? b : a; }
+
+inline uint64_t rotl64(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+template <typename S, typename D, typename F>
+inline void transform_n(const S* src, size_t n, D* dst, F f)
+{
+    for (size_t i = 0; i < n; ++i) dst[i] = f(src[i]);
+}
+
+// fp16 with round to nearest even, after F. Giesen's float_to_half_fast3_rtne
+// and half_to_float_fast5; bit-identical to the F16C instructions.
+inline uint16_t half_from_float(float x)
+{
+    constexpr uint32_t f32_infinity = 255u << 23;
+    constexpr uint32_t f16_overflow = (127u + 16) << 23;
+    constexpr uint32_t denorm_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+    uint32_t f;
+    std::memcpy(&f, &x, sizeof(f));
+    const uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+
+    uint16_t h;
+    if (f >= f16_overflow) {
+        h = f > f32_infinity ? 0x7E00 : 0x7C00; // NaN stays NaN, the rest saturates to infinity
+    } else if (f < (113u << 23)) {
+        // subnormal half: the fp add rounds the mantissa into place
+        float magic, sum;
+        std::memcpy(&magic, &denorm_magic, sizeof(magic));
+        std::memcpy(&sum, &f, sizeof(sum));
+        sum += magic;
+        uint32_t bits;
+        std::memcpy(&bits, &sum, sizeof(bits));
+        h = uint16_t(bits - denorm_magic);
+    } else {
+        const uint32_t odd = (f >> 13) & 1;
+        f += (uint32_t(15 - 127) << 23) + 0xFFF + odd;
+        h = uint16_t(f >> 13);
+    }
+    return uint16_t(h | (sign >> 16));
+}
+
+inline float half_to_float(uint16_t h)
+{
+    constexpr uint32_t shifted_exp = 0x7C00u << 13;
+    uint32_t bits = uint32_t(h & 0x7FFF) << 13;
+    const uint32_t exp = bits & shifted_exp;
+    bits += (127u - 15) << 23;
+    if (exp == shifted_exp) {
+        bits += (128u - 16) << 23; // infinity / NaN
+    } else if (exp == 0) {
+        // subnormal half: renormalise through an fp subtract
+        constexpr uint32_t magic_bits = 113u << 23;
+        float f, magic;
+        bits += 1u << 23;
+        std::memcpy(&f, &bits, sizeof(f));
+        std::memcpy(&magic, &magic_bits, sizeof(magic));
+        f -= magic;
+        std::memcpy(&bits, &f, sizeof(bits));
+    }
+    bits |= uint32_t(h & 0x8000) << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// bf16 is the upper half of an fp32, rounded to nearest even
+inline uint16_t bf16_from_float(float x)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return uint16_t((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+
+inline float bf16_to_float(uint16_t x)
+{
+    const uint32_t bits = uint32_t(x) << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Generic Laplacian: the nine weights of StepCoeffs::lap at run time.
+struct GenericStencil {};
+
+// A symmetric stencil fixed at compile time.
+template <SymmetricStencil S>
+struct FixedStencil {
+    static constexpr SymmetricStencil weights = S;
+};
+
+template <typename Stencil>
+inline constexpr bool is_fixed_stencil = !std::is_same_v<Stencil, GenericStencil>;
+
+// Calls f with the stencil type matching c.lap.
+template <typename F>
+void with_stencil(const StepCoeffs& c, F&& f)
+{
+    // laplacian_stencil.weights() as a plain array, see min_of
+    constexpr SymmetricStencil s = laplacian_stencil;
+    const float lap[9] = {s.corner, s.edge, s.corner, s.edge, s.center, s.edge, s.corner, s.edge, s.corner};
+    bool fixed = true;
+    for (int i = 0; i < 9; ++i) fixed = fixed && lap[i] == c.lap[i];
+    if (fixed) return f(FixedStencil<laplacian_stencil>{});
+    f(GenericStencil{});
+}
+
+// Must follow a fused row, which leaves garbage in the ghost cells.
+inline void wrap_row(float* row, int width)
+{
+    row[-1] = row[width - 1];
+    row[width] = row[0];
+}
+
+// Row y of an ensemble group, wrapped around the grid
+inline const float* ensemble_row(const float* field, const EnsembleArgs& a, int y)
+{
+    y = y < 0 ? y + a.height : y >= a.height ? y - a.height : y;
+    return field + std::ptrdiff_t(y) * a.width * ensemble_lanes;
+}
+
+// Box-Muller for Kernels::normal. k1, k2 are 24-bit uniform integers; the
+// radius comes from u = (k1 + 1) / 2^24 in (0, 1] and the angle from
+// t = k2 / 2^24 in [0, 1). log and sincos follow Cephes' logf and sinf/cosf
+// (about 1 ulp over these ranges), without branches so loops vectorise.
+// log_unit's polynomial after its leading coefficient 7.0376836292e-2
+constexpr float log_poly[] = {-1.1514610310e-1f, 1.1676998740e-1f, -1.2420140846e-1f, 1.4249322787e-1f,
+                              -1.6668057665e-1f, 2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f};
+
+inline float log_unit(float x)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    float e = float(int(bits >> 23) - 126);
+    const uint32_t mbits = (bits & 0x007FFFFFu) | 0x3F000000u; // [0.5, 1)
+    float m;
+    std::memcpy(&m, &mbits, sizeof(m));
+    const bool low = m < 0.70710678f;
+    e -= low ? 1.0f : 0.0f;
+    const float f = m - 1.0f + (low ? m : 0.0f);
+    const float z = f * f;
+    float y = 7.0376836292e-2f;
+    y = y * f - 1.1514610310e-1f;
+    y = y * f + 1.1676998740e-1f;
+    y = y * f - 1.2420140846e-1f;
+    y = y * f + 1.4249322787e-1f;
+    y = y * f - 1.6668057665e-1f;
+    y = y * f + 2.0000714765e-1f;
+    y = y * f - 2.4999993993e-1f;
+    y = y * f + 3.3333331174e-1f;
+    y = y * f * z - 2.12194440e-4f * e - 0.5f * z;
+    return f + y + 0.693359375f * e;
+}
+
+// sin and cos of 2 pi t: quadrant q = round(4 t), then polynomials on
+// [-pi/4, pi/4]
+inline void sincos_2pi(float t, float& s, float& c)
+{
+    const int q = int(t * 4.0f + 0.5f);
+    const float a = (t - float(q) * 0.25f) * 6.28318531f;
+    const float z = a * a;
+    const float sa = a + a * z * ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f);
+    const float ca = 1.0f - 0.5f * z + z * z * ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f);
+    const float sv = q & 1 ? ca : sa;
+    const float cv = q & 1 ? sa : ca;
+    s = q & 2 ? -sv : sv;
+    c = (q + 1) & 2 ? -cv : cv;
+}
+
+inline void box_muller(uint32_t k1, uint32_t k2, float& z0, float& z1)
+{
+    const float r = sqrtf(-2.0f * log_unit(float(k1 + 1) * 0x1p-24f));
+    float s, c;
+    sincos_2pi(float(k2) * 0x1p-24f, s, c);
+    z0 = r * c;
+    z1 = r * s;
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+inline __m256 log_unit(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i bits = _mm256_castps_si256(x);
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+    const __m256 m = _mm256_castsi256_ps(
+        _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F000000)));
+    const __m256 low = _mm256_cmp_ps(m, _mm256_set1_ps(0.70710678f), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(low, one));
+    const __m256 f = _mm256_add_ps(_mm256_sub_ps(m, one), _mm256_and_ps(low, m));
+    const __m256 z = _mm256_mul_ps(f, f);
+    __m256 y = _mm256_set1_ps(7.0376836292e-2f);
+    for (float k : log_poly)
+        y = _mm256_fmadd_ps(y, f, _mm256_set1_ps(k));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, f), z);
+    y = _mm256_fnmadd_ps(_mm256_set1_ps(2.12194440e-4f), e, y);
+    y = _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, y);
+    return _mm256_fmadd_ps(_mm256_set1_ps(0.693359375f), e, _mm256_add_ps(f, y));
+}
+
+inline void sincos_2pi(__m256 t, __m256& s, __m256& c)
+{
+    const __m256i q = _mm256_cvttps_epi32(_mm256_fmadd_ps(t, _mm256_set1_ps(4.0f), _mm256_set1_ps(0.5f)));
+    const __m256 a = _mm256_mul_ps(_mm256_fnmadd_ps(_mm256_cvtepi32_ps(q), _mm256_set1_ps(0.25f), t),
+                                   _mm256_set1_ps(6.28318531f));
+    const __m256 z = _mm256_mul_ps(a, a);
+    __m256 ps = _mm256_fmadd_ps(_mm256_set1_ps(-1.9515295891e-4f), z, _mm256_set1_ps(8.3321608736e-3f));
+    ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(-1.6666654611e-1f));
+    const __m256 sa = _mm256_fmadd_ps(_mm256_mul_ps(a, z), ps, a);
+    __m256 pc = _mm256_fmadd_ps(_mm256_set1_ps(2.443315711809948e-5f), z, _mm256_set1_ps(-1.388731625493765e-3f));
+    pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(4.166664568298827e-2f));
+    const __m256 ca = _mm256_fmadd_ps(_mm256_mul_ps(z, z), pc, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, _mm256_set1_ps(1.0f)));
+    const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+    const __m256 sv = _mm256_blendv_ps(sa, ca, swap);
+    const __m256 cv = _mm256_blendv_ps(ca, sa, swap);
+    // bit 1 of q, and of q + 1, moved to the sign bit
+    const __m256i two = _mm256_set1_epi32(2);
+    s = _mm256_xor_ps(sv, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30)));
+    c = _mm256_xor_ps(cv, _mm256_castsi256_ps(_mm256_slli_epi32(
+                              _mm256_and_si256(_mm256_add_epi32(q, _mm256_set1_epi32(1)), two), 30)));
+}
+
+inline void box_muller(__m256i k1, __m256i k2, __m256& z0, __m256& z1)
+{
+    const __m256 scale = _mm256_set1_ps(0x1p-24f);
+    const __m256 u = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(k1, _mm256_set1_epi32(1))), scale);
+    const __m256 r = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(-2.0f), log_unit(u)));
+    __m256 s, c;
+    sincos_2pi(_mm256_mul_ps(_mm256_cvtepi32_ps(k2), scale), s, c);
+    z0 = _mm256_mul_ps(r, c);
+    z1 = _mm256_mul_ps(r, s);
+}
+#endif
+
+// Temporal blocking: a band of rows is advanced by T steps in a single
+// wavefront sweep. Intermediate steps live in small per-level ring buffers
+// that stay in L2, so u/v are read and un/vn written once per T steps. The
+// band is grown by T rows on each side, shrinking by one row per step, so
+// neighbouring bands need no exchange; rows past the grid edge are read
+// wrapped around. Every row goes through fused_row(u[3], v[3], un, vn), the
+// same row kernel as a single step, so the result is bit-for-bit identical
+// to T single steps.
+template <typename FusedRow>
+void sweep_tile(const TileArgs& a, FusedRow&& fused_row)
+{
+    const int T = int(a.T);
+    auto ring = [&](float* base, int l, int y) {
+        return base + ((l - 1) * tile_ring_rows + (y & (tile_ring_rows - 1))) * a.ring_stride;
+    };
+    // Row y of step l, where step 0 is u/v and step T is un/vn. Intermediate
+    // steps are indexed by the unwrapped row.
+    auto src = [&](const float* first, float* ring_base, int l, int y) -> const float* {
+        if (l == 0) return first + ((y % a.height + a.height) % a.height) * a.stride;
+        return ring(ring_base, l, y);
+    };
+    auto dst = [&](float* last, float* ring_base, int l, int y) -> float* {
+        if (l == T) return last + y * a.stride;
+        return ring(ring_base, l, y);
+    };
+
+    // At front f, step l computes row f - l; step l-1 has already produced
+    // row f - l + 1 in the same front.
+    for (int f = a.row_begin - T + 2; f < a.row_end + T; ++f) {
+        for (int l = 1; l <= T; ++l) {
+            const int y = f - l;
+            if (y < a.row_begin - T + l || y >= a.row_end + T - l) continue;
+            const float* ur[3], * vr[3];
+            for (int k = 0; k < 3; ++k) {
+                ur[k] = src(a.u, a.ring_u, l - 1, y - 1 + k);
+                vr[k] = src(a.v, a.ring_v, l - 1, y - 1 + k);
+            }
+            float* un = dst(a.un, a.ring_u, l, y);
+            float* vn = dst(a.vn, a.ring_v, l, y);
+            fused_row(ur, vr, un, vn);
+            if (l < T) {
+                wrap_row(un, a.width);
+                wrap_row(vn, a.width);
+            }
+        }
+    }
+}
+
+} // namespace
+} // namespace GrayScott::kernels
@@ -0,0 +1,303 @@
+// Kernels in plain C++, vectorised by the compiler for the ISA of the
+// including translation unit, which defines
+//   GS_KERNELS_TABLE  name of the Kernels table
+//   GS_KERNELS_ISA    its Isa
+//   GS_KERNELS_NAME   its name string
+#include <kernels.hpp>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "kernels_common.inl"
+
+#if defined(_MSC_VER)
+#define GS_NOINLINE __declspec(noinline)
+#else
+#define GS_NOINLINE __attribute__((noinline))
+#endif
+
+namespace GrayScott::kernels {
+namespace {
+
+// Loads/stores one cell of a field as fp32.
+struct F32Cell {
+    using T = float;
+    static inline float load(T x) { return x; }
+    static inline T store(float x) { return x; }
+};
+
+struct F16Cell {
+    using T = uint16_t;
+#if defined(__F16C__) || defined(__AVX2__)
+    static inline float load(T x) { return _cvtsh_ss(x); }
+    static inline T store(float x) { return T(_cvtss_sh(x, _MM_FROUND_TO_NEAREST_INT)); }
+#else
+    static inline float load(T x) { return half_to_float(x); }
+    static inline T store(float x) { return half_from_float(x); }
+#endif
+};
+
+struct BF16Cell {
+    using T = uint16_t;
+    static inline float load(T x) { return bf16_to_float(x); }
+    static inline T store(float x) { return bf16_from_float(x); }
+};
+
+// One output row of the fused step, both Laplacians feeding the reaction
+// update directly. Never inlined: the single step and the temporally blocked
+// sweep then run the same machine code, which keeps them bit-identical.
+template <typename Cell, typename Stencil, typename T = typename Cell::T>
+GS_NOINLINE void fused_row(const T* const u[3], const T* const v[3], T* __restrict un, T* __restrict vn,
+                           int width, const StepCoeffs& c)
+{
+    const T* __restrict u0 = u[0];
+    const T* __restrict u1 = u[1];
+    const T* __restrict u2 = u[2];
+    const T* __restrict v0 = v[0];
+    const T* __restrict v1 = v[1];
+    const T* __restrict v2 = v[2];
+    const float* k = c.lap;
+    const float Du = c.Du, Dv = c.Dv, F = c.F, Fk = c.F + c.k, dt = c.dt;
+
+    for (int x = 0; x < width; ++x) {
+        auto lap = [&](const T* r0, const T* r1, const T* r2) {
+            if constexpr (is_fixed_stencil<Stencil>) {
+                constexpr SymmetricStencil S = Stencil::weights;
+                const float edges = (Cell::load(r0[x]) + Cell::load(r2[x])) +
+                                    (Cell::load(r1[x - 1]) + Cell::load(r1[x + 1]));
+                const float corners = (Cell::load(r0[x - 1]) + Cell::load(r2[x - 1])) +
+                                      (Cell::load(r0[x + 1]) + Cell::load(r2[x + 1]));
+                return Cell::load(r1[x]) * S.center + edges * S.edge + corners * S.corner;
+            } else {
+                float acc = Cell::load(r0[x - 1]) * k[0];
+                acc += Cell::load(r0[x]) * k[1];
+                acc += Cell::load(r0[x + 1]) * k[2];
+                acc += Cell::load(r1[x - 1]) * k[3];
+                acc += Cell::load(r1[x]) * k[4];
+                acc += Cell::load(r1[x + 1]) * k[5];
+                acc += Cell::load(r2[x - 1]) * k[6];
+                acc += Cell::load(r2[x]) * k[7];
+                return acc + Cell::load(r2[x + 1]) * k[8];
+            }
+        };
+        const float lu = lap(u0, u1, u2);
+        const float lv = lap(v0, v1, v2);
+        const float uc = Cell::load(u1[x]);
+        const float vc = Cell::load(v1[x]);
+        const float uvv = uc * (vc * vc);
+        const float du = Du * lu - uvv + F * (1.0f - uc);
+        const float dv = Dv * lv + uvv - Fk * vc;
+        un[x] = Cell::store(uc + du * dt);
+        vn[x] = Cell::store(vc + dv * dt);
+    }
+}
+
+template <typename Cell, typename T = typename Cell::T>
+void render_row(const T* __restrict u, const T* __restrict v, int width, uint8_t* __restrict dst,
+                const RenderTarget& r)
+{
+    for (int x = 0; x < width; ++x) {
+        const float s = r.difference ? Cell::load(u[x]) - Cell::load(v[x]) : Cell::load(v[x]);
+        const float t = min_of(max_of((s - r.lo) * r.scale, 0.0f), 255.0f);
+        const uint32_t idx = uint32_t(t);
+        if (r.format == OutputFormat::Gray8)
+            dst[x] = uint8_t(idx);
+        else
+            std::memcpy(dst + 4 * x, &r.lut[idx], 4);
+    }
+}
+
+template <typename F>
+void with_cell(Storage storage, F&& f)
+{
+    switch (storage) {
+    case Storage::f32:  return f(F32Cell{});
+    case Storage::f16:  return f(F16Cell{});
+    case Storage::bf16: return f(BF16Cell{});
+    }
+}
+
+void step_rows(Storage storage, const void* u, const void* v, void* un, void* vn, std::ptrdiff_t stride,
+               int width, int row_begin, int row_end, const StepCoeffs& c, const RenderTarget* out)
+{
+    with_cell(storage, [&](auto cell) {
+        using Cell = decltype(cell);
+        using T = typename Cell::T;
+        for (int y = row_begin; y < row_end; ++y) {
+            const std::ptrdiff_t o = y * stride;
+            const T* uc = static_cast<const T*>(u) + o;
+            const T* vc = static_cast<const T*>(v) + o;
+            const T* ur[3] = {uc - stride, uc, uc + stride};
+            const T* vr[3] = {vc - stride, vc, vc + stride};
+            T* u_out = static_cast<T*>(un) + o;
+            T* v_out = static_cast<T*>(vn) + o;
+            with_stencil(c, [&](auto stencil) {
+                fused_row<Cell, decltype(stencil)>(ur, vr, u_out, v_out, width, c);
+            });
+            // the row is still in L1
+            if (out) render_row<Cell>(u_out, v_out, width, out->data + y * out->pitch, *out);
+        }
+    });
+}
+
+void render_rows(Storage storage, const void* u, const void* v, std::ptrdiff_t stride, int width,
+                 int row_begin, int row_end, const RenderTarget& out)
+{
+    with_cell(storage, [&](auto cell) {
+        using Cell = decltype(cell);
+        using T = typename Cell::T;
+        for (int y = row_begin; y < row_end; ++y)
+            render_row<Cell>(static_cast<const T*>(u) + y * stride, static_cast<const T*>(v) + y * stride, width,
+                             out.data + y * out.pitch, out);
+    });
+}
+
+void advance_tile(const TileArgs& a, const StepCoeffs& c)
+{
+    with_stencil(c, [&](auto stencil) {
+        sweep_tile(a, [&](const float* const ur[3], const float* const vr[3], float* un, float* vn) {
+            fused_row<F32Cell, decltype(stencil)>(ur, vr, un, vn, a.width, c);
+        });
+    });
+}
+
+// Laplacian of lane i of a cell; l, c and r point at the cells left of,
+// at and right of it in the rows above (0), at (1) and below (2).
+inline float ensemble_laplacian(const float* const l[3], const float* const c[3], const float* const r[3], int i)
+{
+    constexpr SymmetricStencil S = laplacian_stencil;
+    const float edges = (c[0][i] + c[2][i]) + (l[1][i] + r[1][i]);
+    const float corners = (l[0][i] + l[2][i]) + (r[0][i] + r[2][i]);
+    return c[1][i] * S.center + edges * S.edge + corners * S.corner;
+}
+
+// The lanes of a cell are independent, the inner loop vectorises across
+// ensemble members.
+void step_ensemble_rows(const EnsembleArgs& a, int row_begin, int row_end)
+{
+    constexpr int L = ensemble_lanes;
+    float F[L], Fk[L];
+    std::memcpy(F, a.F, sizeof(F));
+    std::memcpy(Fk, a.Fk, sizeof(Fk));
+    const float Du = a.Du, Dv = a.Dv, dt = a.dt;
+    for (int y = row_begin; y < row_end; ++y) {
+        const float* u[3], * v[3];
+        for (int k = 0; k < 3; ++k) {
+            u[k] = ensemble_row(a.u, a, y - 1 + k);
+            v[k] = ensemble_row(a.v, a, y - 1 + k);
+        }
+        float* un = a.un + std::ptrdiff_t(y) * a.width * L;
+        float* vn = a.vn + std::ptrdiff_t(y) * a.width * L;
+        for (int x = 0; x < a.width; ++x) {
+            const std::ptrdiff_t l = std::ptrdiff_t(x == 0 ? a.width - 1 : x - 1) * L;
+            const std::ptrdiff_t c = std::ptrdiff_t(x) * L;
+            const std::ptrdiff_t r = std::ptrdiff_t(x + 1 == a.width ? 0 : x + 1) * L;
+            const float* ul[3] = {u[0] + l, u[1] + l, u[2] + l};
+            const float* uc[3] = {u[0] + c, u[1] + c, u[2] + c};
+            const float* ur[3] = {u[0] + r, u[1] + r, u[2] + r};
+            const float* vl[3] = {v[0] + l, v[1] + l, v[2] + l};
+            const float* vc[3] = {v[0] + c, v[1] + c, v[2] + c};
+            const float* vr[3] = {v[0] + r, v[1] + r, v[2] + r};
+            float lu[L], lv[L];
+            for (int i = 0; i < L; ++i) {
+                lu[i] = ensemble_laplacian(ul, uc, ur, i);
+                lv[i] = ensemble_laplacian(vl, vc, vr, i);
+            }
+            float* __restrict uo = un + c;
+            float* __restrict vo = vn + c;
+            for (int i = 0; i < L; ++i) {
+                const float u1 = uc[1][i], v1 = vc[1][i];
+                const float uvv = u1 * (v1 * v1);
+                uo[i] = u1 + (Du * lu[i] - uvv + F[i] * (1.0f - u1)) * dt;
+                vo[i] = v1 + (Dv * lv[i] + uvv - Fk[i] * v1) * dt;
+            }
+        }
+    }
+}
+
+void step_rows_tracked(const float* u, const float* v, float* un, float* vn, std::ptrdiff_t stride, int width,
+                       int row_begin, int row_end, const StepCoeffs& c, float* change)
+{
+    with_stencil(c, [&](auto stencil) {
+        for (int y = row_begin; y < row_end; ++y) {
+            const std::ptrdiff_t o = y * stride;
+            const float* ur[3] = {u + o - stride, u + o, u + o + stride};
+            const float* vr[3] = {v + o - stride, v + o, v + o + stride};
+            fused_row<F32Cell, decltype(stencil)>(ur, vr, un + o, vn + o, width, c);
+            // the row is still in L1
+            for (int x0 = 0; x0 < width; x0 += change_cols) {
+                const int x1 = min_of(x0 + change_cols, width);
+                float m = change[x0 / change_cols];
+                for (int x = x0; x < x1; ++x)
+                    m = max_of(m, max_of(fabsf(un[o + x] - u[o + x]), fabsf(vn[o + x] - v[o + x])));
+                change[x0 / change_cols] = m;
+            }
+        }
+    });
+}
+
+void narrow(Storage storage, const float* src, uint16_t* dst, size_t n)
+{
+    if (storage == Storage::f16)
+        transform_n(src, n, dst, F16Cell::store);
+    else
+        transform_n(src, n, dst, BF16Cell::store);
+}
+
+void widen(Storage storage, const uint16_t* src, float* dst, size_t n)
+{
+    if (storage == Storage::f16)
+        transform_n(src, n, dst, F16Cell::load);
+    else
+        transform_n(src, n, dst, BF16Cell::load);
+}
+
+void uniform(RngLanes& rng, float* out, size_t n)
+{
+    uint64_t s[4][rng_lanes];
+    std::memcpy(s, rng.s, sizeof(s));
+    for (size_t i = 0; i < n; i += 2 * rng_lanes) {
+        for (int l = 0; l < rng_lanes; ++l) {
+            const uint64_t r = rotl64(s[0][l] + s[3][l], 23) + s[0][l];
+            const uint64_t t = s[1][l] << 17;
+            s[2][l] ^= s[0][l];
+            s[3][l] ^= s[1][l];
+            s[1][l] ^= s[2][l];
+            s[0][l] ^= s[3][l];
+            s[2][l] ^= t;
+            s[3][l] = rotl64(s[3][l], 45);
+            out[i + 2 * l] = float(uint32_t(r) >> 8) * 0x1p-24f;
+            out[i + 2 * l + 1] = float(uint32_t(r >> 32) >> 8) * 0x1p-24f;
+        }
+    }
+    std::memcpy(rng.s, s, sizeof(s));
+}
+
+void normal(RngLanes& rng, float* out, size_t n)
+{
+    uint64_t s[4][rng_lanes];
+    std::memcpy(s, rng.s, sizeof(s));
+    for (size_t i = 0; i < n; i += 2 * rng_lanes) {
+        for (int l = 0; l < rng_lanes; ++l) {
+            const uint64_t r = rotl64(s[0][l] + s[3][l], 23) + s[0][l];
+            const uint64_t t = s[1][l] << 17;
+            s[2][l] ^= s[0][l];
+            s[3][l] ^= s[1][l];
+            s[1][l] ^= s[2][l];
+            s[0][l] ^= s[3][l];
+            s[2][l] ^= t;
+            s[3][l] = rotl64(s[3][l], 45);
+            box_muller(uint32_t(r) >> 8, uint32_t(r >> 32) >> 8, out[i + l], out[i + rng_lanes + l]);
+        }
+    }
+    std::memcpy(rng.s, s, sizeof(s));
+}
+
+} // namespace
+
+const Kernels GS_KERNELS_TABLE{GS_KERNELS_ISA, GS_KERNELS_NAME, step_rows, render_rows, advance_tile, narrow, widen,
+                               step_ensemble_rows, step_rows_tracked, uniform, normal};
+
+} // namespace GrayScott::kernels
@@ -0,0 +1,6 @@
+// Baseline kernels: whatever the compiler's default target vectorises to
+// (SSE2 on x86-64). Always available, the fallback of kernels::best().
+#define GS_KERNELS_TABLE scalar_kernels
+#define GS_KERNELS_ISA Isa::scalar
+#define GS_KERNELS_NAME "scalar"
+#include "kernels_portable.inl"
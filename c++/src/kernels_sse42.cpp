@@ -0,0 +1,5 @@
+// SSE4.2 kernels, compiler vectorised 4 cells per vector.
+#define GS_KERNELS_TABLE sse42_kernels
+#define GS_KERNELS_ISA Isa::sse42
+#define GS_KERNELS_NAME "sse42"
+#include "kernels_portable.inl"
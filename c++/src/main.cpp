@@ -1,9 +1,27 @@
 #include <iostream>
 #include <matrix.hpp>
 #include <matrix_ops.hpp>
-//#include <gray_scott.hpp>
+#include <gray_scott.hpp>
+#include <kernels.hpp>
+#include <pipeline.hpp>
+#include <encoder.hpp>
+#include <ensemble.hpp>
+#include <domain.hpp>
 #include <Eigen/Dense>
 #include <profiler.hpp>
+#include <trace.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 using namespace matrix;
 
@@ -46,6 +64,18 @@ void test_matrix()
 
     mat3[0][1][2] = 31.4f;
     std::cout << "mat3(0,1,2) = " << mat3[0][1][2] << std::endl;
+    std::cout << "mat3(0,1,2) = " << mat3(0, 1, 2) << " view(0,1,2) = " << v(0, 1, 2) << std::endl;
+
+    auto padded = Matrix2f32::zeros({10, 1366}, Layout{.halo = 1, .row_align = 64});
+    padded({9, 1365}) = 2.0f;
+    std::cout << "padded 10x1366 pitch: " << padded.get_strides()[0]
+              << " row 1 aligned: " << (reinterpret_cast<uintptr_t>(&padded({1, 0})) % 64 == 0 ? "YES" : "NO")
+              << " total bytes: " << padded.total_bytes()
+              << " copy equal: " << (padded.copy() == padded ? "YES" : "NO") << std::endl;
+    float row_sum = 0.0f;
+    for (auto row : padded.view().rows())
+        for (float x : row) row_sum += x;
+    std::cout << "padded sum over rows(): " << row_sum << " row(9)[1365] = " << padded.row(9)[1365] << std::endl;
 }
 
 void test_eigen()
@@ -67,6 +97,38 @@ void test_eigen()
     mat.setZero();
 }
 
+// A backend initialized again at another size steps as a fresh one would,
+// temporally blocked so the tile scratch has to follow the new width.
+void test_reinitialize()
+{
+    auto make_params = [](unsigned Nx, unsigned Ny) {
+        GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.5f, Nx, Ny, 10, 0, {}, 0};
+        params.time_block = 4;
+        return params;
+    };
+    const std::string type = GrayScott::kernels::find("avx2") ? "avx2" : "auto";
+    auto reused = GrayScott::Backend::create(type);
+    auto fresh = GrayScott::Backend::create(type);
+    const auto small = make_params(64, 32), large = make_params(64, 600);
+    bool ok = reused->initialize(small);
+    reused->gray_scott_steps(small.dt, 8);
+    ok = ok && reused->initialize(large) && fresh->initialize(large);
+    reused->gray_scott_steps(large.dt, 8);
+    fresh->gray_scott_steps(large.dt, 8);
+    const size_t cells = size_t(large.Nx) * large.Ny;
+    std::vector<float> u0(cells), v0(cells), u1(cells), v1(cells);
+    reused->read_state(u0.data(), v0.data());
+    fresh->read_state(u1.data(), v1.data());
+    ok = ok && u0 == u1 && v0 == v1;
+    std::cout << type << " re-initialized 64x32 -> 64x600 matches fresh: " << (ok ? "YES" : "NO") << std::endl;
+}
+
+// Medians of the hardware counter rates of each section
+void print_perf(const Profiler& p, std::ostream& os)
+{
+    for (const auto& [k, v] : p.get_perf_measurements()) os << k << ": " << median(v) << std::endl;
+}
+
 void test_conv(size_t n=10, size_t n_runs=100)
 {
     auto A = randu<float>(n,n);
@@ -81,6 +143,10 @@ void test_conv(size_t n=10, size_t n_runs=100)
     memcpy(K.get_data(), kernel_data, sizeof(kernel_data));
 
     ops::conv3x3_f32(A, K, B1);
+    if (!GrayScott::kernels::cpu_supports(GrayScott::kernels::Isa::avx2)) {
+        std::cout << "conv3x3_f32_avx2: no AVX2 on this CPU, skipped" << std::endl;
+        return;
+    }
     ops::conv3x3_f32_avx2(A, K, B2);
 
     const auto is_same = B1 == B2;
@@ -90,30 +156,268 @@ void test_conv(size_t n=10, size_t n_runs=100)
               << " is almost equal : " << (almost_equal ? "YES":"NO") << std::endl;
     
     Profiler p;
+    const bool perf = p.enable_perf_counters();
+    const uint64_t cells = uint64_t(n) * n * n_runs;
     { 
-        Profiler::Section section(p, "conv3x3_f32");
+        Profiler::Section section(p, "conv3x3_f32", cells);
         for (int i=0;i<n_runs;++i) {
             ops::conv3x3_f32(A, K, B1);
         }
     }
     { 
-        Profiler::Section section(p, "conv3x3_f32_avx2");
+        Profiler::Section section(p, "conv3x3_f32_avx2", cells);
         for (int i=0;i<n_runs;++i) {
             ops::conv3x3_f32_avx2(A, K, B2);
         }
     }
+    if (GrayScott::kernels::cpu_supports(GrayScott::kernels::Isa::avx512)) {
+        auto B3 = zeros<float>(n,n);
+        ops::conv3x3_f32_avx512(A, K, B3);
+        std::cout << "conv3x3_f32 avx vs avx512 : is_same :" << (B2 == B3 ? "YES":"NO") << std::endl;
+        Profiler::Section section(p, "conv3x3_f32_avx512", cells);
+        for (size_t i=0;i<n_runs;++i) {
+            ops::conv3x3_f32_avx512(A, K, B3);
+        }
+    }
     auto measurements = p.get_measurements("us");
     for (const auto& [k,v] : measurements) {
         std::cout << k << ": " << median(v)/n_runs<< " us over " << n_runs << " runs" << std::endl;
     }
+    if (perf)
+        print_perf(p, std::cout);
+    else
+        std::cout << "perf counters unavailable" << std::endl;
 }
 
+// gray-scott stream <file|-> [y4m|ppm] [size] [frames] [steps_per_frame] [backend] [buffered|direct|mmap]
+// Runs headless and writes every frame, e.g.
+//   gray-scott stream - y4m 1024 600 20 | ffmpeg -i - loop.mp4
+int stream(int argc, char* argv[])
+{
+    auto arg = [&](int i, const char* fallback) { return std::string(argc > i ? argv[i] : fallback); };
+    const std::string path = arg(2, "-");
+    const auto format = arg(3, "y4m") == "ppm" ? GrayScott::StreamFormat::PPM : GrayScott::StreamFormat::Y4M;
+    const unsigned n = std::stoul(arg(4, "512"));
+    const unsigned frames = std::stoul(arg(5, "300"));
+    const unsigned every = std::stoul(arg(6, "10"));
+    const std::string backend_type = arg(7, "threaded");
+    const std::string mode_name = arg(8, "buffered");
+    const auto mode = mode_name == "direct" ? GrayScott::WriteMode::direct
+                    : mode_name == "mmap"   ? GrayScott::WriteMode::mmap
+                                            : GrayScott::WriteMode::buffered;
+
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.5f, n, n, 10, 0, {}, 0};
+    auto backend = GrayScott::Backend::create(backend_type);
+    if (!backend || !backend->initialize(params)) {
+        std::cerr << "cannot initialize backend " << backend_type << std::endl;
+        return 1;
+    }
+    auto encoder = GrayScott::FrameEncoder::open(path, format, n, n, 30, mode);
+    if (!encoder) {
+        std::cerr << "cannot open " << path << std::endl;
+        return 1;
+    }
+
+    GrayScott::Pipeline::Options options;
+    options.substeps = every;
+    options.drop_frames = false;
+    GrayScott::Pipeline pipeline(*backend, params, GrayScott::Colormap{}, options,
+        [&](const uint8_t* pixels, size_t pitch, uint64_t) { encoder->write_frame(pixels, pitch); });
+
+    Profiler p;
+    p.enable_perf_counters();
+    GrayScott::Pipeline::Stats stats;
+    {
+        Profiler::Section section(p, "stream", uint64_t(n) * n * frames * every);
+        stats = pipeline.run(uint64_t(frames) * every);
+    }
+    const bool ok = encoder->close();
+    std::cerr << stats.frames_rendered << " frames, " << stats.steps << " steps, "
+              << encoder->bytes_written() << " bytes in " << median(p.get_measurements("ms")["stream"])
+              << " ms" << (ok ? "" : ", write failed") << std::endl;
+    print_perf(p, std::cerr);
+    return ok ? 0 : 1;
+}
+
+// gray-scott atlas <file|-> [size] [steps] [columns] [rows] [backend]
+// Steps columns x rows thumbnails of size x size as one ensemble, F from 0.01
+// to 0.07 across and k from 0.045 to 0.07 down, and writes the atlas as PPM.
+int atlas(int argc, char* argv[])
+{
+    auto arg = [&](int i, const char* fallback) { return std::string(argc > i ? argv[i] : fallback); };
+    const std::string path = arg(2, "-");
+    const unsigned n = std::stoul(arg(3, "128"));
+    const unsigned steps = std::stoul(arg(4, "2000"));
+    const unsigned columns = std::stoul(arg(5, "8"));
+    const unsigned rows = std::stoul(arg(6, "8"));
+    const std::string type = arg(7, "threaded");
+
+    std::vector<GrayScott::EnsembleMember> members;
+    for (unsigned r = 0; r < rows; ++r)
+        for (unsigned c = 0; c < columns; ++c)
+            members.push_back({0.01f + 0.06f * c / std::max(columns - 1, 1u),
+                               0.045f + 0.025f * r / std::max(rows - 1, 1u)});
+
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.5f, n, n, 10, 0, {}, 0};
+    auto ensemble = GrayScott::Ensemble::create(type);
+    if (!ensemble || !ensemble->initialize(params, members)) {
+        std::cerr << "cannot initialize ensemble " << type << std::endl;
+        return 1;
+    }
+    auto encoder = GrayScott::FrameEncoder::open(path, GrayScott::StreamFormat::PPM, columns * n, rows * n, 1);
+    if (!encoder) {
+        std::cerr << "cannot open " << path << std::endl;
+        return 1;
+    }
+
+    Profiler p;
+    p.enable_perf_counters();
+    {
+        Profiler::Section section(p, "atlas", uint64_t(n) * n * members.size() * steps);
+        ensemble->gray_scott_steps(params.dt, steps);
+    }
+    std::vector<uint32_t> pixels(size_t(columns) * n * rows * n);
+    ensemble->copy_atlas_to_output(columns, pixels.data(), GrayScott::OutputFormat::RGBA8, 0);
+    const bool ok = encoder->write_frame(reinterpret_cast<const uint8_t*>(pixels.data()), size_t(columns) * n * 4) && encoder->close();
+    std::cerr << members.size() << " members, " << steps << " steps in "
+              << median(p.get_measurements("ms")["atlas"]) << " ms" << (ok ? "" : ", write failed") << std::endl;
+    print_perf(p, std::cerr);
+    return ok ? 0 : 1;
+}
+
+// gray-scott trace <file.json> [size] [frames] [steps_per_frame] [backend]
+// Runs the frame pipeline with tracing on and writes the per-thread steps,
+// bands and frames as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+int trace_run(int argc, char* argv[])
+{
+    auto arg = [&](int i, const char* fallback) { return std::string(argc > i ? argv[i] : fallback); };
+    const std::string path = arg(2, "trace.json");
+    const unsigned n = std::stoul(arg(3, "1024"));
+    const unsigned frames = std::stoul(arg(4, "20"));
+    const unsigned every = std::stoul(arg(5, "10"));
+    const std::string backend_type = arg(6, "threaded");
+
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.5f, n, n, 10, 0, {}, 0};
+    auto backend = GrayScott::Backend::create(backend_type);
+    if (!backend || !backend->initialize(params)) {
+        std::cerr << "cannot initialize backend " << backend_type << std::endl;
+        return 1;
+    }
+    GrayScott::Pipeline::Options options;
+    options.substeps = every;
+    options.drop_frames = false;
+    GrayScott::Pipeline pipeline(*backend, params, GrayScott::Colormap{}, options,
+                                 [](const uint8_t*, size_t, uint64_t) {});
+
+    trace::set_thread_name("solver");
+    trace::enable();
+    const auto stats = pipeline.run(uint64_t(frames) * every);
+    trace::enable(false);
+
+    std::ofstream out(path);
+    const bool ok = trace::write_chrome_json(out);
+    std::cerr << stats.frames_rendered << " frames, " << stats.steps << " steps, "
+              << trace::collect().size() << " spans" << (ok ? "" : ", write failed") << std::endl;
+    return ok ? 0 : 1;
+}
+
+#ifdef __linux__
+// gray-scott domain [rows] [cols] [size] [steps] [backend] [pin]
+// Splits a size x size grid into rows x cols subdomains, steps each in its own
+// process with the halos exchanged through shared memory (domain.hpp), and
+// compares the result with the same run in this process. "pin" puts the
+// processes on NUMA nodes round robin.
+int domain(int argc, char* argv[])
+{
+    auto arg = [&](int i, const char* fallback) { return std::string(argc > i ? argv[i] : fallback); };
+    const unsigned rows = std::stoul(arg(2, "2"));
+    const unsigned cols = std::stoul(arg(3, "2"));
+    const unsigned n = std::stoul(arg(4, "1024"));
+    const unsigned steps = std::stoul(arg(5, "1000"));
+    const std::string type = arg(6, "threaded");
+    const bool pin = arg(7, "") == "pin";
+
+    const std::string name = "gray-scott-" + std::to_string(::getpid());
+    auto shared = GrayScott::SharedDomain::create(name, n, n, rows, cols);
+    if (!shared) {
+        std::cerr << "cannot create a " << rows << "x" << cols << " domain in shared memory" << std::endl;
+        return 1;
+    }
+    GrayScott::Params params{0.16f, 0.08f, 0.0367f, 0.0649f, 1.0f, 0.5f, n, n, 10, 0, {}, 0};
+    params.pattern = GrayScott::Pattern::spots;
+    params.threads = std::max(std::thread::hardware_concurrency() / shared->size(), 1u);
+
+    // the processes gather their U and V here
+    const size_t cells = size_t(n) * n;
+    void* p = ::mmap(nullptr, 2 * cells * sizeof(float), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return 1;
+    float* gathered = static_cast<float*>(p);
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < shared->size(); ++i) {
+        if (::fork() != 0) continue;
+        // as a process started on its own would
+        auto domain = GrayScott::SharedDomain::open(name);
+        const auto index = domain ? domain->claim() : std::nullopt;
+        if (!index) ::_exit(1);
+        if (pin) GrayScott::pin_to_numa_node(*index % GrayScott::numa_node_count());
+        auto backend = GrayScott::Backend::create(type, domain, *index);
+        if (!backend || !backend->initialize(params)) ::_exit(1);
+        backend->gray_scott_steps(params.dt, steps);
+        const GrayScott::Subdomain s = domain->subdomain(*index);
+        std::vector<float> u(size_t(s.Nx) * s.Ny), v(u.size());
+        backend->read_state(u.data(), v.data());
+        for (unsigned r = 0; r < s.Nx; ++r) {
+            std::copy_n(u.data() + size_t(r) * s.Ny, s.Ny, gathered + size_t(s.row0 + r) * n + s.col0);
+            std::copy_n(v.data() + size_t(r) * s.Ny, s.Ny, gathered + cells + size_t(s.row0 + r) * n + s.col0);
+        }
+        ::_exit(0);
+    }
+    bool ok = true;
+    for (unsigned i = 0; i < shared->size(); ++i) {
+        int status = 0;
+        ::wait(&status);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    GrayScott::SharedDomain::unlink(name);
+    if (!ok) {
+        std::cerr << "a subdomain of backend " << type << " failed" << std::endl;
+        return 1;
+    }
+
+    auto backend = GrayScott::Backend::create(type);
+    params.threads.reset();
+    if (!backend || !backend->initialize(params)) return 1;
+    backend->gray_scott_steps(params.dt, steps);
+    std::vector<float> u(cells), v(cells);
+    backend->read_state(u.data(), v.data());
+    float du = 0.0f, dv = 0.0f;
+    for (size_t i = 0; i < cells; ++i) {
+        du = std::max(du, std::fabs(u[i] - gathered[i]));
+        dv = std::max(dv, std::fabs(v[i] - gathered[cells + i]));
+    }
+    ::munmap(p, 2 * cells * sizeof(float));
+    std::cerr << rows << "x" << cols << " processes, " << steps << " steps of " << n << "x" << n << " in " << ms
+              << " ms; max |dU| " << du << ", |dV| " << dv << " against one process" << std::endl;
+    return 0;
+}
+#endif
+
 int main(int argc, char* argv[]) 
 {
-    std::cout << "Gray-Scott Simulation" << std::endl;
+    if (argc > 1 && std::strcmp(argv[1], "stream") == 0) return stream(argc, argv);
+    if (argc > 1 && std::strcmp(argv[1], "atlas") == 0) return atlas(argc, argv);
+    if (argc > 1 && std::strcmp(argv[1], "trace") == 0) return trace_run(argc, argv);
+#ifdef __linux__
+    if (argc > 1 && std::strcmp(argv[1], "domain") == 0) return domain(argc, argv);
+#endif
+
+    std::cout << "Gray-Scott Simulation, " << GrayScott::kernels::best().name << " kernels" << std::endl;
 
     test_matrix();
     test_eigen();
+    test_reinitialize();
 
     size_t n = argc > 1 ? std::stoul(argv[1]) : 10;
     size_t n_run = argc > 2 ? std::stoul(argv[2]) : 100;
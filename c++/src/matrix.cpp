@@ -1,13 +1,20 @@
 #include <matrix.hpp>
+#include <kernels.hpp>
 #include <vector>
-#include "XoshiroCpp.hpp"
-#include <random>
 #include <algorithm>
+#include <bit>
 #include <cstdint>  // For uint32_t
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
 
 #ifdef MSVC_VER
 #include <immintrin.h>
 #endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 namespace {
 uint64_t gen_seed() 
@@ -29,26 +36,200 @@ uint64_t gen_seed()
 }
 }
 
-using XoshiroRNG = XoshiroCpp::Xoshiro256PlusPlus;
-
 namespace matrix
 {
+void* allocate_storage(size_t bytes, size_t alignment, Pages pages, size_t& mapped)
+{
+    mapped = 0;
+#ifdef __linux__
+    constexpr size_t huge_page = size_t(2) << 20;
+    const size_t huge_bytes = (bytes + huge_page - 1) / huge_page * huge_page;
+    if (pages == Pages::hugetlb && bytes) {
+        void* p = mmap(nullptr, huge_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            mapped = huge_bytes;
+            return p;
+        }
+        pages = Pages::huge; // no huge pages reserved
+    }
+    // below one huge page there is nothing to gain
+    if (pages == Pages::huge && bytes >= huge_page) {
+        void* p = std::aligned_alloc(huge_page, huge_bytes);
+        if (p) madvise(p, huge_bytes, MADV_HUGEPAGE);
+        return p;
+    }
+#else
+    (void)pages;
+#endif
+    return _aligned_alloc_(alignment, bytes);
+}
+
+void free_storage(void* storage, size_t mapped)
+{
+#ifdef __linux__
+    if (mapped) {
+        munmap(storage, mapped);
+        return;
+    }
+#endif
+    _aligned_free_(storage);
+}
+
+struct BufferPool::Impl {
+    using Key = std::tuple<size_t, size_t, Pages>; // size class, alignment, pages
+    mutable std::mutex mutex;
+    std::map<Key, std::vector<std::pair<void*, size_t>>> free; // storage, mapped
+    std::unordered_map<void*, Block> in_use;
+    Stats stats;
+};
+
+BufferPool::BufferPool(size_t max_cached_bytes) : impl(std::make_unique<Impl>()), max_cached_bytes(max_cached_bytes) {}
+
+std::shared_ptr<BufferPool> BufferPool::create(size_t max_cached_bytes)
+{
+    return std::shared_ptr<BufferPool>(new BufferPool(max_cached_bytes));
+}
+
+BufferPool::~BufferPool()
+{
+    trim();
+}
+
+size_t BufferPool::size_class(size_t bytes)
+{
+    if (bytes <= 4096) return (bytes + 255) / 256 * 256;
+    const size_t step = std::bit_floor(bytes) / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+void* BufferPool::acquire(size_t bytes, size_t alignment, Pages pages, bool& fresh)
+{
+    const size_t size = size_class(bytes);
+    std::unique_lock lock(impl->mutex);
+    auto& list = impl->free[{size, alignment, pages}];
+    if (!list.empty()) {
+        const auto [storage, mapped] = list.back();
+        list.pop_back();
+        impl->stats.cached_bytes -= size;
+        ++impl->stats.hits;
+        impl->in_use[storage] = {size, alignment, pages, mapped};
+        fresh = false;
+        return storage;
+    }
+    ++impl->stats.misses;
+    lock.unlock();
+    size_t mapped = 0;
+    void* storage = allocate_storage(size, alignment, pages, mapped);
+    fresh = true;
+    if (!storage) return nullptr;
+    lock.lock();
+    impl->in_use[storage] = {size, alignment, pages, mapped};
+    return storage;
+}
+
+void BufferPool::release(void* storage)
+{
+    std::unique_lock lock(impl->mutex);
+    const auto it = impl->in_use.find(storage);
+    if (it == impl->in_use.end()) return;
+    const Block b = it->second;
+    impl->in_use.erase(it);
+    if (impl->stats.cached_bytes + b.bytes > max_cached_bytes) {
+        lock.unlock();
+        free_storage(storage, b.mapped);
+        return;
+    }
+    impl->free[{b.bytes, b.alignment, b.pages}].emplace_back(storage, b.mapped);
+    impl->stats.cached_bytes += b.bytes;
+}
+
+void BufferPool::trim()
+{
+    std::lock_guard lock(impl->mutex);
+    for (auto& [key, list] : impl->free)
+        for (auto [storage, mapped] : list) free_storage(storage, mapped);
+    impl->free.clear();
+    impl->stats.cached_bytes = 0;
+}
+
+BufferPool::Stats BufferPool::stats() const
+{
+    std::lock_guard lock(impl->mutex);
+    return impl->stats;
+}
+
+namespace {
+thread_local std::shared_ptr<BufferPool> current_pool;
+}
+
+BufferPool::Scope::Scope(std::shared_ptr<BufferPool> pool) : previous(std::move(current_pool))
+{
+    current_pool = std::move(pool);
+}
+
+BufferPool::Scope::~Scope()
+{
+    current_pool = std::move(previous);
+}
+
+const std::shared_ptr<BufferPool>& BufferPool::current()
+{
+    return current_pool;
+}
+
+namespace {
+using GrayScott::kernels::RngLanes;
+using GrayScott::kernels::rng_lanes;
+
+// Blocks of rng_block elements from their own substreams; generate takes a
+// whole number of 2 * rng_lanes
+void fill_blocks(float* data, size_t size, uint64_t seed, const ParallelFor& parallel_for,
+                 void (*generate)(RngLanes&, float*, size_t))
+{
+    const size_t blocks = (size + rng_block - 1) / rng_block;
+    const auto streams = GrayScott::kernels::rng_substreams(seed, blocks);
+    auto body = [&](size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            RngLanes rng = streams[b];
+            float* out = data + b * rng_block;
+            const size_t n = std::min(rng_block, size - b * rng_block);
+            const size_t whole = n / (2 * rng_lanes) * (2 * rng_lanes);
+            generate(rng, out, whole);
+            if (whole < n) {
+                float tail[2 * rng_lanes];
+                generate(rng, tail, 2 * rng_lanes);
+                std::copy(tail, tail + (n - whole), out + whole);
+            }
+        }
+    };
+    if (parallel_for)
+        parallel_for(blocks, body);
+    else
+        body(0, blocks);
+}
+} // namespace
+
+template <>
+void randu<float>(float* data, size_t size, uint64_t seed, const ParallelFor& parallel_for)
+{
+    fill_blocks(data, size, seed, parallel_for, GrayScott::kernels::best().uniform);
+}
+
 template <>
 void randu<float>(float* data, size_t size)
 {
-    XoshiroRNG rng(gen_seed());
-    auto gen_float = [&]() -> float {
-        uint32_t u = rng() >> 8;  // 24-bit mantissa for float [0,1)
-        return (u + 0.5f) * (1.0f / (1u << 24));
-    };
-    std::generate(data, data + size, gen_float);
+    randu(data, size, gen_seed());
+}
+
+template <>
+void randn<float>(float* data, size_t size, uint64_t seed, const ParallelFor& parallel_for)
+{
+    fill_blocks(data, size, seed, parallel_for, GrayScott::kernels::best().normal);
 }
 
 template <>
 void randn<float>(float* data, size_t size)
 {
-    XoshiroRNG rng(gen_seed());
-    std::normal_distribution<float> dist(0, 1);
-    std::generate(data, data + size, [&]() { return dist(rng); });
+    randn(data, size, gen_seed());
 }
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include <pipeline.hpp>
+#include <trace.hpp>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace {
+constexpr uint64_t closed_bit = uint64_t(1) << 63;
+constexpr std::align_val_t slot_align{64};
+
+size_t element_size(GrayScott::Storage storage)
+{
+    return storage == GrayScott::Storage::f32 ? 4 : 2;
+}
+}
+
+namespace GrayScott {
+
+FrameRing::FrameRing(size_t n_slots, size_t slot_bytes)
+    : slots(std::max<size_t>(n_slots, 1))
+{
+    for (auto& s : slots) {
+        s.data = {static_cast<std::byte*>(::operator new[](slot_bytes, slot_align)),
+                  [](std::byte* p) { ::operator delete[](p, slot_align); }};
+    }
+}
+
+FrameRing::Slot* FrameRing::try_acquire()
+{
+    const uint64_t h = head.load(std::memory_order_relaxed) & ~closed_bit;
+    if (h - tail.load(std::memory_order_acquire) == slots.size()) return nullptr;
+    return &slots[h % slots.size()];
+}
+
+FrameRing::Slot* FrameRing::wait_acquire()
+{
+    const uint64_t h = head.load(std::memory_order_relaxed) & ~closed_bit;
+    for (;;) {
+        const uint64_t t = tail.load(std::memory_order_acquire);
+        if (h - t != slots.size()) return &slots[h % slots.size()];
+        tail.wait(t, std::memory_order_acquire);
+    }
+}
+
+void FrameRing::publish()
+{
+    head.fetch_add(1, std::memory_order_release);
+    head.notify_one();
+}
+
+FrameRing::Slot* FrameRing::try_front()
+{
+    const uint64_t t = tail.load(std::memory_order_relaxed);
+    if ((head.load(std::memory_order_acquire) & ~closed_bit) == t) return nullptr;
+    return &slots[t % slots.size()];
+}
+
+FrameRing::Slot* FrameRing::wait_front()
+{
+    const uint64_t t = tail.load(std::memory_order_relaxed);
+    for (;;) {
+        const uint64_t h = head.load(std::memory_order_acquire);
+        if ((h & ~closed_bit) != t) return &slots[t % slots.size()];
+        if (h & closed_bit) return nullptr;
+        head.wait(h, std::memory_order_acquire);
+    }
+}
+
+void FrameRing::release()
+{
+    tail.fetch_add(1, std::memory_order_release);
+    tail.notify_one();
+}
+
+void FrameRing::close()
+{
+    head.fetch_or(closed_bit, std::memory_order_release);
+    head.notify_all();
+}
+
+bool FrameRing::closed() const
+{
+    return head.load(std::memory_order_acquire) & closed_bit;
+}
+
+Pipeline::Pipeline(Backend& backend, const Params& params, const Colormap& colormap,
+                   const Options& options, FrameSink sink)
+    : backend(backend), params(params), colormap(colormap), options(options), sink(std::move(sink))
+{
+    layout = backend.front();
+    const size_t bytes = layout.rows * layout.pitch * element_size(layout.storage);
+    plane_bytes = (bytes + 63) / 64 * 64;
+}
+
+// A frame is a copy of the front fields in their storage type, pitch
+// included, so render_frame can run on it with aligned loads. U is only
+// copied when the colormap reads it.
+bool Pipeline::publish_frame(FrameRing& ring, uint64_t step)
+{
+    trace::Scope<"publish"> scope{uint32_t(step)};
+    FrameRing::Slot* slot = options.drop_frames ? ring.try_acquire() : ring.wait_acquire();
+    if (!slot) return false;
+    const FieldView f = backend.front();
+    std::memcpy(slot->data.get(), f.V, f.rows * f.pitch * element_size(f.storage));
+    if (colormap.source == Colormap::Source::U_minus_V)
+        std::memcpy(slot->data.get() + plane_bytes, f.U, f.rows * f.pitch * element_size(f.storage));
+    slot->step = step;
+    ring.publish();
+    return true;
+}
+
+void Pipeline::consume(FrameRing& ring)
+{
+    const size_t bpp = options.format == OutputFormat::Gray8 ? 1 : 4;
+    const size_t pitch = options.pitch ? options.pitch : layout.cols * bpp;
+    std::vector<uint8_t> pixels(layout.rows * pitch);
+    trace::set_thread_name("render");
+
+    while (FrameRing::Slot* slot = ring.wait_front()) {
+        const std::byte* V = slot->data.get();
+        const std::byte* U = colormap.source == Colormap::Source::U_minus_V ? V + plane_bytes : V;
+        const FieldView frame{U, V, layout.storage, layout.pitch, layout.rows, layout.cols};
+        const uint64_t step = slot->step;
+        {
+            trace::Scope<"render"> scope{uint32_t(step)};
+            render_frame(frame, colormap, pixels.data(), options.format, pitch);
+        }
+        ring.release();
+        trace::Scope<"sink"> scope{uint32_t(step)};
+        sink(pixels.data(), pitch, step);
+        frames_rendered.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+Pipeline::Stats Pipeline::run(uint64_t n_steps)
+{
+    using clock = std::chrono::steady_clock;
+    const unsigned substeps = std::max(options.substeps, 1u);
+    const auto period = params.fps ? std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(1.0 / params.fps)) : clock::duration::zero();
+
+    FrameRing ring(options.ring_slots,
+                   colormap.source == Colormap::Source::U_minus_V ? 2 * plane_bytes : plane_bytes);
+    stop_requested.store(false, std::memory_order_relaxed);
+    frames_rendered.store(0, std::memory_order_relaxed);
+    std::thread consumer(&Pipeline::consume, this, std::ref(ring));
+
+    Stats stats;
+    auto deadline = clock::now();
+    while (stats.steps < n_steps && !stop_requested.load(std::memory_order_relaxed)) {
+        backend.gray_scott_steps(params.dt, substeps);
+        stats.steps += substeps;
+
+        if (publish_frame(ring, stats.steps)) ++stats.frames_published;
+        else ++stats.frames_dropped;
+
+        if (period != clock::duration::zero()) {
+            deadline += period;
+            const auto now = clock::now();
+            // a solver that fell behind starts over rather than bursting
+            if (deadline < now) deadline = now;
+            else std::this_thread::sleep_until(deadline);
+        }
+    }
+
+    ring.close();
+    consumer.join();
+    stats.frames_rendered = frames_rendered.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace GrayScott
@@ -0,0 +1,96 @@
+#include <thread_pool.hpp>
+#include <trace.hpp>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace {
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+}
+
+namespace parallel {
+
+void SpinBarrier::arrive_and_wait()
+{
+    const unsigned gen = generation.load(std::memory_order_acquire);
+    if (waiting.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+        waiting.store(0, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+        generation.notify_all();
+        return;
+    }
+    for (unsigned i = 0; i < spin_count; ++i) {
+        if (generation.load(std::memory_order_acquire) != gen) return;
+        cpu_relax();
+    }
+    while (generation.load(std::memory_order_acquire) == gen) {
+        generation.wait(gen, std::memory_order_acquire);
+    }
+}
+
+unsigned ThreadPool::size_for(unsigned n_threads)
+{
+    if (n_threads == 0) n_threads = std::thread::hardware_concurrency();
+    return n_threads == 0 ? 1 : n_threads;
+}
+
+ThreadPool::ThreadPool(unsigned n_threads)
+    : n_workers(size_for(n_threads)),
+      start(n_workers),
+      done(n_workers)
+{
+    threads.reserve(n_workers - 1);
+    for (unsigned i = 1; i < n_workers; ++i) {
+        threads.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    stopping = true;
+    if (!threads.empty()) start.arrive_and_wait();
+    for (auto& t : threads) t.join();
+}
+
+void ThreadPool::dispatch(Invoke fn, void* ctx)
+{
+    if (threads.empty()) {
+        fn(ctx, 0);
+        return;
+    }
+    // the workers are busy, waiting for them would never end
+    if (running.exchange(true, std::memory_order_acquire)) {
+        for (unsigned i = 0; i < n_workers; ++i) fn(ctx, i);
+        return;
+    }
+    invoke = fn;
+    context = ctx;
+    start.arrive_and_wait();
+    invoke(context, 0);
+    done.arrive_and_wait();
+    running.store(false, std::memory_order_release);
+}
+
+void ThreadPool::worker_loop(unsigned index)
+{
+    trace::set_thread_name("worker " + std::to_string(index));
+    for (;;) {
+        start.arrive_and_wait();
+        if (stopping) return;
+        invoke(context, index);
+        done.arrive_and_wait();
+    }
+}
+
+} // namespace parallel